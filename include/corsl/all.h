@@ -14,8 +14,16 @@
 #include "start.h"
 #include "when_all.h"
 #include "when_any.h"
+#include "when_n.h"
+#include "as_completed.h"
+#include "hedge.h"
 #include "compatible_base.h"
 #include "async_timer.h"
 #include "advanced_io.h"
 #include "async_queue.h"
+#include "async_mpsc_queue.h"
+#include "bounded_async_queue.h"
 #include "promise.h"
+#include "task.h"
+#include "when_all_bounded.h"
+#include "async_cache.h"
@@ -0,0 +1,171 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "impl/when_all_when_any_base.h"
+#include "srwlock.h"
+#include "future.h"
+#include "async_generator.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		///////////////////////////////////
+		// as_completed
+		template<class Awaitable>
+		using as_completed_value_t = std::decay_t<invoke_result<get_result_type_t<Awaitable>>>;
+
+		// Awaitables that cannot run a completion node are awaited by a wrapping future
+		template<class Awaitable>
+		inline future<as_completed_value_t<Awaitable>> as_completed_wrap(Awaitable task)
+		{
+			co_return co_await task;
+		}
+
+		template<class Awaitable>
+		using as_completed_task_t = std::conditional_t<node_awaitable<Awaitable>, Awaitable, future<as_completed_value_t<Awaitable>>>;
+
+		// Children push their indices to a single completion queue, the generator pops them in order of completion.
+		// Children keep the state alive, so the generator may be destroyed before all of them complete
+		template<class Task>
+		struct as_completed_state
+		{
+			srwlock lock;
+			std::vector<size_t> completed;	// reserved for all children, so pushing never allocates
+			size_t head{};
+			std::coroutine_handle<> waiting{};	// the generator waiting for the next completed child
+			std::vector<Task> tasks;
+			std::vector<shared_child_node> nodes;
+
+			template<class Range>
+			as_completed_state(Range &&range)
+			{
+				if constexpr (!node_awaitable<sr::range_value_t<Range>>)
+				{
+					tasks.reserve(sr::size(range));
+					for (auto &&item : range)
+					{
+						if constexpr (std::copyable<sr::range_value_t<Range>>)
+							tasks.push_back(as_completed_wrap(item));
+						else
+							tasks.push_back(as_completed_wrap(std::move(item)));
+					}
+				}
+				else if constexpr (std::copyable<Task>)
+					tasks.assign(sr::begin(range), sr::end(range));
+				else
+					tasks.assign(std::make_move_iterator(sr::begin(range)), std::make_move_iterator(sr::end(range)));
+
+				completed.reserve(tasks.size());
+				nodes.resize(tasks.size());
+			}
+
+			static void complete(completion_node *node) noexcept
+			{
+				const auto child = static_cast<shared_child_node *>(node);
+				const auto master = std::move(child->master);
+				auto &state = *static_cast<as_completed_state *>(master.get());
+
+				std::unique_lock l{ state.lock };
+				state.completed.push_back(child->index);
+				if (auto resume = std::exchange(state.waiting, {}))
+				{
+					l.unlock();
+					resume();
+				}
+			}
+
+			static void start(const std::shared_ptr<as_completed_state> &state) noexcept
+			{
+				for (size_t i = 0; i < state->tasks.size(); ++i)
+				{
+					auto &node = state->nodes[i];
+					node.on_complete = &complete;
+					node.master = state;
+					node.index = i;
+					if (!state->tasks[i].set_node(node))
+						complete(&node);
+				}
+			}
+
+			// The generator only waits here while its consumer is awaiting the next item, so it cannot be destroyed
+			// while registered as waiting
+			struct next_awaiter
+			{
+				as_completed_state &state;
+				size_t index;
+
+				static bool await_ready() noexcept
+				{
+					return false;
+				}
+
+				bool await_suspend(std::coroutine_handle<> handle) noexcept
+				{
+					std::scoped_lock l{ state.lock };
+					if (state.head != state.completed.size())
+					{
+						index = state.completed[state.head++];
+						return false;
+					}
+					state.waiting = handle;
+					return true;
+				}
+
+				size_t await_resume() noexcept
+				{
+					if (index == ~size_t{})
+					{
+						std::scoped_lock l{ state.lock };
+						index = state.completed[state.head++];
+					}
+					return index;
+				}
+			};
+
+			next_awaiter next() noexcept
+			{
+				return { *this, ~size_t{} };
+			}
+		};
+
+		template<class Task, class T = as_completed_value_t<Task>>
+		using as_completed_item_t = std::conditional_t<std::is_void_v<T>, size_t, std::pair<size_t, T>>;
+
+		template<class Task>
+		inline async_generator<as_completed_item_t<Task>> as_completed_impl(std::shared_ptr<as_completed_state<Task>> state)
+		{
+			as_completed_state<Task>::start(state);
+			for (size_t i = 0; i < state->tasks.size(); ++i)
+			{
+				const auto index = co_await state->next();
+				auto &task = state->tasks[index];
+				if constexpr (std::is_void_v<as_completed_value_t<Task>>)
+				{
+					get_ready_result(task);
+					co_yield index;
+				}
+				else
+					co_yield std::pair<size_t, as_completed_value_t<Task>>{ index, get_ready_result(task) };
+			}
+		}
+
+		// Yields std::pair<size_t, T> of a child index and its result as soon as each child completes
+		// (just the index for void children). Iteration ends with the exception of the first failed child
+		template<sr::sized_range Range>
+		inline auto as_completed(Range &&range)
+		{
+			using task_t = as_completed_task_t<std::decay_t<sr::range_value_t<Range>>>;
+			return as_completed_impl(std::make_shared<as_completed_state<task_t>>(std::forward<Range>(range)));
+		}
+	}
+
+	using details::as_completed;
+}
@@ -0,0 +1,306 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <bit>
+#include <list>
+#include <unordered_map>
+
+#include "srwlock.h"
+#include "future.h"
+#include "promise.h"
+#include "shared_future.h"
+#include "tp_timer.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		struct async_cache_options
+		{
+			size_t capacity{ 1024 };	// least recently used entries are evicted above this size, 0 means unbounded
+			std::chrono::steady_clock::duration ttl{};	// counted from load completion, 0 means values never expire
+			std::chrono::steady_clock::duration stale_while_revalidate{};	// expired value is still served while it is reloaded
+			size_t shards{ 16 };
+		};
+
+		// Single-flight asynchronous cache
+		// Concurrent requests for a missing key share one in-flight load. Failed loads are not cached.
+		template<class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>>
+		class async_cache
+		{
+			static_assert(!std::is_void_v<V>, "async_cache<K, void> is not supported");
+
+			using clock = std::chrono::steady_clock;
+
+			struct entry
+			{
+				shared_future<V> value;
+				shared_future<V> refresh;	// in-flight revalidation
+				uint64_t generation{};	// of the last started load
+				clock::time_point fresh_until{ clock::time_point::max() };
+				clock::time_point stale_until{ clock::time_point::max() };
+				typename std::list<K>::iterator lru;
+			};
+
+			struct shard
+			{
+				srwlock lock;
+				std::unordered_map<K, entry, Hash, KeyEqual> entries;
+				std::list<K> lru;	// most recently used first
+				size_t capacity{};	// 0 means unbounded
+			};
+
+			// Loads keep the state alive, so they may outlive the cache
+			struct state
+			{
+				const async_cache_options options;
+				const size_t count;
+				std::unique_ptr<shard[]> shards;
+				std::atomic<uint64_t> generation{ 0 };
+				[[no_unique_address]] Hash hash;
+
+				// A power of 2 that leaves at least one entry for every shard
+				static size_t get_shard_count(const async_cache_options &options) noexcept
+				{
+					const auto count = std::bit_ceil(std::max<size_t>(options.shards, 1));
+					return options.capacity ? std::min(count, std::bit_floor(options.capacity)) : count;
+				}
+
+				explicit state(const async_cache_options &options_) :
+					options{ options_ },
+					count{ get_shard_count(options_) },
+					shards{ new shard[count] }
+				{
+					// the remainder is spread over the first shards, so the capacities add up to options.capacity
+					if (options.capacity)
+					{
+						for (size_t i = 0; i < count; ++i)
+							shards[i].capacity = options.capacity / count + (i < options.capacity % count);
+					}
+				}
+
+				size_t shard_count() const noexcept
+				{
+					return count;
+				}
+
+				shard &get_shard(const K &key) noexcept
+				{
+					return shards[hash(key) & (shard_count() - 1)];
+				}
+
+				void loaded(const K &key, uint64_t generation_)
+				{
+					auto &s = get_shard(key);
+					const auto now = clock::now();
+					std::scoped_lock l{ s.lock };
+					const auto it = s.entries.find(key);
+					if (it == s.entries.end() || it->second.generation != generation_)
+						return;
+
+					auto &e = it->second;
+					if (e.refresh)
+						e.value = std::move(e.refresh);
+					if (options.ttl.count())
+					{
+						e.fresh_until = now + options.ttl;
+						e.stale_until = e.fresh_until + options.stale_while_revalidate;
+					}
+				}
+
+				void failed(const K &key, uint64_t generation_)
+				{
+					auto &s = get_shard(key);
+					std::scoped_lock l{ s.lock };
+					const auto it = s.entries.find(key);
+					if (it == s.entries.end() || it->second.generation != generation_)
+						return;
+
+					// a failed revalidation keeps the stale value, a failed load is forgotten
+					if (it->second.refresh)
+						it->second.refresh = {};
+					else
+					{
+						s.lru.erase(it->second.lru);
+						s.entries.erase(it);
+					}
+				}
+
+				void sweep()
+				{
+					const auto now = clock::now();
+					for (size_t i = 0; i < shard_count(); ++i)
+					{
+						auto &s = shards[i];
+						std::scoped_lock l{ s.lock };
+						for (auto it = s.entries.begin(); it != s.entries.end();)
+						{
+							if (now >= it->second.stale_until)
+							{
+								s.lru.erase(it->second.lru);
+								it = s.entries.erase(it);
+							}
+							else
+								++it;
+						}
+					}
+				}
+			};
+
+			std::shared_ptr<state> state_;
+			tp_timer<> timer;
+			future<> sweeper;
+
+			template<class F>
+			static fire_and_forget<> load(std::shared_ptr<state> state_, K key, F loader, promise<V> promise_, uint64_t generation)
+			{
+				try
+				{
+					auto value = co_await loader(std::as_const(key));
+					state_->loaded(key, generation);
+					promise_.set_inline(std::move(value));
+				}
+				catch (...)
+				{
+					state_->failed(key, generation);
+					promise_.set_exception_inline(std::current_exception());
+				}
+			}
+
+			future<> sweep_loop()
+			{
+				for (;;)
+				{
+					const auto result = co_await timer.wait(std::nothrow);
+					if (!result)
+						break;
+					state_->sweep();
+				}
+			}
+
+		public:
+			explicit async_cache(const async_cache_options &options = {}) :
+				state_{ std::make_shared<state>(options) }
+			{
+				if (options.ttl.count())
+				{
+					const auto interval = std::chrono::duration_cast<winrt::Windows::Foundation::TimeSpan>(options.ttl + options.stale_while_revalidate);
+					timer.start(interval, interval);
+					sweeper = sweep_loop();
+				}
+			}
+
+			~async_cache()
+			{
+				if (sweeper)
+				{
+					timer.cancel();
+					sweeper.wait();
+				}
+			}
+
+			async_cache(const async_cache &) = delete;
+			async_cache &operator =(const async_cache &) = delete;
+
+			// Returns a cached or in-flight value for the key, calls loader(key) to start a new load when there is none.
+			// Loader returns an awaitable producing V
+			template<class F>
+			shared_future<V> get(const K &key, F &&loader)
+			{
+				auto &s = state_->get_shard(key);
+				const auto now = clock::now();
+
+				std::unique_lock l{ s.lock };
+				auto it = s.entries.find(key);
+				if (it != s.entries.end() && now < it->second.stale_until)
+				{
+					auto &e = it->second;
+					s.lru.splice(s.lru.begin(), s.lru, e.lru);
+					if (now < e.fresh_until || e.refresh)
+						return e.value;
+
+					// serve the stale value and revalidate it in background
+					promise<V> promise_;
+					e.refresh = promise_.get_future();
+					e.generation = ++state_->generation;
+					auto result = e.value;
+					const auto generation = e.generation;
+					l.unlock();
+					load(state_, key, std::forward<F>(loader), std::move(promise_), generation);
+					return result;
+				}
+
+				promise<V> promise_;
+				shared_future<V> result{ promise_.get_future() };
+				const auto generation = ++state_->generation;
+				if (it == s.entries.end())
+				{
+					s.lru.push_front(key);
+					it = s.entries.try_emplace(key).first;
+					it->second.lru = s.lru.begin();
+					if (s.capacity && s.entries.size() > s.capacity)
+					{
+						s.entries.erase(s.lru.back());
+						s.lru.pop_back();
+					}
+				}
+				else
+				{
+					s.lru.splice(s.lru.begin(), s.lru, it->second.lru);
+					it->second.refresh = {};
+					it->second.fresh_until = it->second.stale_until = clock::time_point::max();
+				}
+				it->second.value = result;
+				it->second.generation = generation;
+				l.unlock();
+
+				load(state_, key, std::forward<F>(loader), std::move(promise_), generation);
+				return result;
+			}
+
+			void invalidate(const K &key)
+			{
+				auto &s = state_->get_shard(key);
+				std::scoped_lock l{ s.lock };
+				if (const auto it = s.entries.find(key); it != s.entries.end())
+				{
+					s.lru.erase(it->second.lru);
+					s.entries.erase(it);
+				}
+			}
+
+			void clear()
+			{
+				for (size_t i = 0; i < state_->shard_count(); ++i)
+				{
+					auto &s = state_->shards[i];
+					std::scoped_lock l{ s.lock };
+					s.entries.clear();
+					s.lru.clear();
+				}
+			}
+
+			size_t size() const
+			{
+				size_t result = 0;
+				for (size_t i = 0; i < state_->shard_count(); ++i)
+				{
+					auto &s = state_->shards[i];
+					std::scoped_lock l{ s.lock };
+					result += s.entries.size();
+				}
+				return result;
+			}
+		};
+	}
+
+	using details::async_cache_options;
+	using details::async_cache;
+}
@@ -20,7 +20,7 @@ namespace corsl
 		class async_generator;
 
 		template<class T>
-		struct __declspec(empty_bases)promise_type : public promise_base0
+		struct __declspec(empty_bases)promise_type : public promise_base0, frame_allocation_base
 		{
 			mutable srwlock lock;
 			using variant_t = std::variant<std::monostate, T, std::exception_ptr>;
@@ -84,12 +84,9 @@ namespace corsl
 				return awaitable{ this };
 			}
 
-			template<class V>
-			void return_value(V &&value_) noexcept
+			// Generator ends with co_return; or by flowing off the end, the waiting consumer is resumed at final suspend
+			static void return_void() noexcept
 			{
-				std::scoped_lock l{ lock };
-				value = std::forward<V>(value_);
-				// no resuming right now - wait until final suspend
 			}
 
 			void unhandled_exception() noexcept
@@ -130,21 +127,20 @@ namespace corsl
 
 			auto final_suspend() noexcept
 			{
+				// Always suspends: the frame is destroyed by async_generator, and iterators check coro.done() after the end
 				struct final_suspend_t
 				{
 					promise_type *promise;
 
-					bool await_ready() const noexcept
+					static bool await_ready() noexcept
 					{
-						if (promise->is_ready_impl() && promise->continuation)
-							return false;
-						else
-							return true;
+						return false;
 					}
 
 					void await_suspend(std::coroutine_handle<>) noexcept
 					{
-						promise->continuation();
+						promise->lock.lock();
+						promise->check_resume();
 					}
 
 					void await_resume() const noexcept
@@ -0,0 +1,270 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "impl/dependencies.h"
+#include "impl/frame_allocator.h"
+#include "compatible_base.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		// Lock-free multiple producers - single consumer queue
+		// Values are kept in an intrusive list of nodes (D. Vyukov's MPSC node queue): a producer exchanges the head and
+		// then links the previous head to its node, the consumer owns the tail, which is always a node without a value.
+		// Nodes are allocated from producers' thread caches of frame_allocator and are returned there by the consumer.
+		// The consumer parks by publishing its awaitable with a new generation, producers claim it after publishing a node
+		template<class T, class Scheduler = callback_policy::empty>
+		class async_mpsc_queue
+		{
+			using executor_type = executor_t<Scheduler>;
+
+			struct node
+			{
+				std::atomic<node *> next{};
+				std::optional<T> value;
+			};
+
+			static_assert(alignof(node) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Over-aligned values are not supported");
+
+			class awaitable
+			{
+				friend class async_mpsc_queue;
+
+				async_mpsc_queue *queue;
+				std::coroutine_handle<> handle;
+
+			public:
+				awaitable(async_mpsc_queue *queue) noexcept :
+					queue{ queue }
+				{}
+
+				// no move and copy
+				awaitable(const awaitable &) = delete;
+				awaitable &operator =(const awaitable &) = delete;
+
+				bool await_ready() const noexcept
+				{
+					return queue->is_ready();
+				}
+
+				bool await_suspend(std::coroutine_handle<> handle_) noexcept
+				{
+					handle = handle_;
+					return queue->park(this);
+				}
+
+				T await_resume()
+				{
+					return queue->take();
+				}
+			};
+
+			enum : int { no_exception, setting_exception, has_exception };
+
+			alignas(64) std::atomic<node *> head;	// last pushed node, shared by producers
+			// Generation of the last park shifted left by one, the low bit is set while the consumer is parked.
+			// The generation prevents the consumer from taking back a later park after it has been resumed elsewhere
+			std::atomic<uint64_t> park_state{};
+			awaitable *waiter{};	// written by the consumer before it parks
+			std::atomic<int> exception_state{ no_exception };
+			std::exception_ptr exception;
+			alignas(64) node *tail;	// owned by the consumer
+			[[no_unique_address]] executor_type executor;
+
+			static node *allocate_node()
+			{
+				return new (frame_allocator::allocate(sizeof(node))) node{};
+			}
+
+			static void free_node(node *n) noexcept
+			{
+				n->~node();
+				frame_allocator::deallocate(n);
+			}
+
+			bool failed() const noexcept
+			{
+				return exception_state.load(std::memory_order_acquire) == has_exception;
+			}
+
+			// seq_cst pairs with the consumer's store in park: either the producer sees the park or the consumer sees the node.
+			// Only the observed park is claimed: if that fails, another producer or the consumer itself has taken it.
+			// A claimed park may have started after the consumer had already taken this node; then the park is published
+			// again with a new generation and checked the same way park does, so the consumer is never resumed on an empty queue
+			void wake() noexcept
+			{
+				auto observed = park_state.load(std::memory_order_seq_cst);
+				while (observed & 1)
+				{
+					if (!park_state.compare_exchange_strong(observed, observed & ~uint64_t{ 1 }, std::memory_order_acq_rel, std::memory_order_relaxed))
+						return;
+
+					// the consumer stays suspended until the park is claimed again, so its tail can be read
+					const auto last = tail;
+					if (failed() || head.load(std::memory_order_seq_cst) != last)
+					{
+						executor.schedule(waiter->handle);
+						return;
+					}
+
+					observed += 2;
+					park_state.store(observed, std::memory_order_seq_cst);
+					if (!failed() && head.load(std::memory_order_seq_cst) == last)
+						return;
+				}
+			}
+
+			bool is_ready() const noexcept
+			{
+				return failed() || head.load(std::memory_order_seq_cst) != tail;
+			}
+
+			// Returns false if the consumer should not suspend. Once the park is published, a producer may resume the
+			// consumer on another thread, so the consumer's state is only read before that
+			bool park(awaitable *pointer) noexcept
+			{
+				const auto last = tail;
+				const auto parked = park_state.load(std::memory_order_relaxed) + 2 | 1;
+				waiter = pointer;
+				park_state.store(parked, std::memory_order_seq_cst);
+				if (failed() || head.load(std::memory_order_seq_cst) != last)
+				{
+					// take the park back, unless a producer has already claimed it and is going to resume the consumer
+					auto expected = parked;
+					if (park_state.compare_exchange_strong(expected, parked & ~uint64_t{ 1 }, std::memory_order_acq_rel))
+						return false;
+				}
+				return true;
+			}
+
+			T take()
+			{
+				if (failed()) [[unlikely]]
+					std::rethrow_exception(exception);
+
+				for (;;)
+				{
+					if (const auto next = tail->next.load(std::memory_order_acquire))
+					{
+						T value = std::move(*next->value);
+						next->value.reset();
+						free_node(std::exchange(tail, next));
+						return value;
+					}
+					// the queue is not empty, but a producer has exchanged the head and not linked its node yet
+					if (failed()) [[unlikely]]
+						std::rethrow_exception(exception);
+					std::this_thread::yield();
+				}
+			}
+
+			void publish(node *n) noexcept
+			{
+				const auto prev = head.exchange(n, std::memory_order_seq_cst);
+				prev->next.store(n, std::memory_order_release);
+				wake();
+			}
+
+		public:
+			async_mpsc_queue(const async_mpsc_queue &) = delete;
+			async_mpsc_queue &operator =(const async_mpsc_queue &) = delete;
+
+			async_mpsc_queue() :
+				head{ allocate_node() },
+				tail{ head.load(std::memory_order_relaxed) }
+			{}
+
+			explicit async_mpsc_queue(const executor_type &executor) :
+				async_mpsc_queue{}
+			{
+				this->executor = executor;
+			}
+
+			~async_mpsc_queue()
+			{
+				for (auto n = tail; n;)
+					free_node(std::exchange(n, n->next.load(std::memory_order_relaxed)));
+			}
+
+			template<class V>
+			void push(V &&item)
+			{
+				emplace(std::forward<V>(item));
+			}
+
+			template<class...Args>
+			void emplace(Args &&...args)
+			{
+				if (failed()) [[unlikely]]
+					return;
+
+				const auto n = allocate_node();
+				try
+				{
+					n->value.emplace(std::forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					free_node(n);
+					throw;
+				}
+				publish(n);
+			}
+
+			void cancel()
+			{
+				push_exception(std::make_exception_ptr(operation_cancelled{}));
+			}
+
+			// Only the first exception is kept, subsequent push calls are ignored
+			void push_exception(std::exception_ptr exception_)
+			{
+				int expected = no_exception;
+				if (exception_state.compare_exchange_strong(expected, setting_exception, std::memory_order_acquire))
+				{
+					exception = std::move(exception_);
+					exception_state.store(has_exception, std::memory_order_seq_cst);
+					wake();
+				}
+			}
+
+			// Must only be called by the consumer
+			awaitable next() noexcept
+			{
+				return { this };
+			}
+
+			// Must only be called by the consumer
+			void clear() noexcept
+			{
+				while (const auto next = tail->next.load(std::memory_order_acquire))
+				{
+					next->value.reset();
+					free_node(std::exchange(tail, next));
+				}
+				if (failed())
+				{
+					exception = {};
+					exception_state.store(no_exception, std::memory_order_release);
+				}
+			}
+
+			// Must only be called by the consumer
+			[[nodiscard]]
+			bool empty() const noexcept
+			{
+				return head.load(std::memory_order_acquire) == tail;
+			}
+		};
+	}
+
+	using details::async_mpsc_queue;
+}
@@ -22,22 +22,27 @@ namespace corsl
 	{
 		namespace bi = boost::intrusive;
 
-		template<class T, class Queue = std::queue<T>, class CallbackPolicy = callback_policy::empty>
+		// Scheduler is either a callback policy or an executor used to resume consumers
+		template<class T, class Queue = std::queue<T>, class Scheduler = callback_policy::empty>
 		class async_multi_consumer_queue
 		{
 			using queue_t = Queue;
+			using executor_type = executor_t<Scheduler>;
 			struct awaitable_base : public boost::intrusive::list_base_hook<bi::link_mode<bi::normal_link>>
 			{
+				bool batch{ false };
 			};
 
 			using awaitable = aq_awaitable<async_multi_consumer_queue, T, awaitable_base>;
+			using batch_awaitable = aq_batch_awaitable<async_multi_consumer_queue, T, awaitable_base>;
 			friend typename awaitable;
+			friend typename batch_awaitable;
 
 			mutable srwlock queue_lock;
 			queue_t queue;
-			bi::list<awaitable, bi::constant_time_size<true>> clients;
+			bi::list<awaitable_base, bi::constant_time_size<true>> clients;
 			std::exception_ptr exception{};
-			PTP_CALLBACK_ENVIRON pce{};
+			[[no_unique_address]] executor_type executor;
 
 			bool is_ready(std::variant<std::monostate, std::exception_ptr, T> &value)
 			{
@@ -72,42 +77,110 @@ namespace corsl
 				return true;
 			}
 
-			void drain([[maybe_unused]] std::unique_lock<srwlock> &&lock, T &&value)
+			bool is_batch_ready(batch_awaitable *pointer)
+			{
+				std::scoped_lock l{ queue_lock };
+				if (exception) [[unlikely]]
+				{
+					pointer->set_exception(exception);
+					return true;
+				}
+				if (!queue.empty() || !pointer->max)
+				{
+					pointer->take(queue);
+					return true;
+				}
+				return false;
+			}
+
+			bool set_batch_awaitable(batch_awaitable *pointer)
+			{
+				std::scoped_lock l{ queue_lock };
+				if (exception) [[unlikely]]
+					std::rethrow_exception(exception);
+				if (!queue.empty())
+				{
+					pointer->take(queue);
+					return false;
+				}
+				pointer->batch = true;
+				clients.push_back(*pointer);
+				return true;
+			}
+
+			static std::coroutine_handle<> get_handle(awaitable_base &client) noexcept
+			{
+				if (client.batch)
+					return static_cast<batch_awaitable &>(client).handle;
+				else
+					return static_cast<awaitable &>(client).handle;
+			}
+
+			// Called with the lock held. Gives the value to the first client and returns true if the client
+			// should be removed from the list and resumed. A batch client stays first until it is full
+			bool give(awaitable_base &client, T &&value)
+			{
+				if (client.batch)
+				{
+					auto &batch = static_cast<batch_awaitable &>(client);
+					batch.add(std::move(value));
+					return batch.full();
+				}
+				static_cast<awaitable &>(client).set_result(std::move(value));
+				return true;
+			}
+
+			// The client is resumed after the lock is released, as an inline executor may run it right away
+			void drain(std::unique_lock<srwlock> lock, T &&value)
 			{
-				lock;	// executing under lock
 				if (!clients.empty())
 				{
 					auto it = clients.begin();
 					auto *cur = std::addressof(*it);
 					clients.erase(it);
 
-					cur->set_result(std::move(value));
-					resume_on_background<CallbackPolicy>(cur->handle);
+					give(*cur, std::move(value));
+					const auto handle = get_handle(*cur);
+					lock.unlock();
+					executor.schedule(handle);
 				}
 				else
 					queue.emplace(std::move(value));
 			}
 
 		public:
-			async_multi_consumer_queue(PTP_CALLBACK_ENVIRON pce = nullptr) noexcept :
-				pce{ pce }
+			async_multi_consumer_queue() = default;
+
+			explicit async_multi_consumer_queue(const executor_type &executor) :
+				executor{ executor }
+			{}
+
+			async_multi_consumer_queue(PTP_CALLBACK_ENVIRON pce) noexcept requires std::constructible_from<executor_type, PTP_CALLBACK_ENVIRON> :
+				executor{ pce }
 			{}
 
-			async_multi_consumer_queue(callback_environment &ce) noexcept :
-				pce{ ce.get() }
+			async_multi_consumer_queue(callback_environment &ce) noexcept requires std::constructible_from<executor_type, PTP_CALLBACK_ENVIRON> :
+				executor{ ce.get() }
 			{}
 
 			template<class Alloc>
-			requires std::uses_allocator_v<Queue, Alloc>
+			requires std::uses_allocator_v<Queue, Alloc> && std::constructible_from<executor_type, PTP_CALLBACK_ENVIRON>
 			explicit async_multi_consumer_queue(PTP_CALLBACK_ENVIRON pce, const Alloc &alloc) :
-				pce{ pce },
+				executor{ pce },
 				queue{ alloc }
 			{}
 
 			template<class Alloc>
-			requires std::uses_allocator_v<Queue, Alloc>
+			requires std::uses_allocator_v<Queue, Alloc> && std::constructible_from<executor_type, PTP_CALLBACK_ENVIRON>
 			explicit async_multi_consumer_queue(callback_environment &ce, const Alloc &alloc) :
-				pce{ ce.get() },
+				executor{ ce.get() },
+				queue{ alloc }
+			{}
+
+			template<class Alloc>
+			requires std::uses_allocator_v<Queue, Alloc>
+			async_multi_consumer_queue(const executor_type &executor, const Alloc &alloc) :
+				executor{ executor },
 				queue{ alloc }
 			{}
 
@@ -137,6 +210,38 @@ namespace corsl
 					drain(std::move(l), T{ std::forward<Args>(args)... });
 			}
 
+			// Adds all values from the range. Waiting clients are served in order and resumed in one batch after
+			// the lock is released
+			template<std::ranges::input_range Range>
+			void push_range(Range &&range)
+			{
+				std::vector<std::coroutine_handle<>> handles;
+				{
+					std::scoped_lock l{ queue_lock };
+					if (exception) [[unlikely]]
+						return;
+
+					for (auto &&item : range)
+					{
+						if (clients.empty())
+							queue.emplace(std::forward<decltype(item)>(item));
+						else if (give(clients.front(), T{ std::forward<decltype(item)>(item) }))
+						{
+							handles.push_back(get_handle(clients.front()));
+							clients.pop_front();
+						}
+					}
+
+					// a batch client that has received fewer than max values
+					if (!clients.empty() && clients.front().batch && static_cast<batch_awaitable &>(clients.front()).count)
+					{
+						handles.push_back(get_handle(clients.front()));
+						clients.pop_front();
+					}
+				}
+				schedule_bulk(executor, handles);
+			}
+
 			void cancel()
 			{
 				push_exception(std::make_exception_ptr(operation_cancelled{}));
@@ -152,14 +257,17 @@ namespace corsl
 					std::swap(clients, clients_copy);
 				}
 
-				auto b = clients_copy.begin();
-				const auto e = clients_copy.end();
-				for (decltype(b) next; b != e; b = next)
+				std::vector<std::coroutine_handle<>> handles;
+				handles.reserve(clients_copy.size());
+				for (auto &client : clients_copy)
 				{
-					b->set_exception(exception_);
-					next = std::next(b);
-					resume_on_background<CallbackPolicy>(b->handle);
+					if (client.batch)
+						static_cast<batch_awaitable &>(client).set_exception(exception_);
+					else
+						static_cast<awaitable &>(client).set_exception(exception_);
+					handles.push_back(get_handle(client));
 				}
+				schedule_bulk(executor, handles);
 			}
 
 			awaitable next() noexcept
@@ -167,6 +275,13 @@ namespace corsl
 				return{ this };
 			}
 
+			// Waits until the queue is not empty and appends up to max values to out under a single lock.
+			// Produces the number of values appended
+			batch_awaitable next_batch(size_t max, std::vector<T> &out) noexcept
+			{
+				return{ this, max, out };
+			}
+
 			void clear() noexcept
 			{
 				std::unique_lock l{ queue_lock };
@@ -68,17 +68,90 @@ namespace corsl
 			}
 		};
 
-		template<class T, class Queue = std::queue<T>, class CallbackPolicy = callback_policy::empty>
+		// Receives up to max values, appended to out, in a single resumption
+		template<class Master, class T, class Base = awaitable_empty_base>
+		struct aq_batch_awaitable : public Base
+		{
+			std::coroutine_handle<> handle;
+			Master *master;
+			std::vector<T> &out;
+			const size_t max;
+			size_t count{};
+			std::exception_ptr exception{};
+
+			aq_batch_awaitable(Master *master, size_t max, std::vector<T> &out) noexcept :
+				master{ master },
+				out{ out },
+				max{ max }
+			{}
+
+			// no move and copy
+			aq_batch_awaitable(const aq_batch_awaitable &) = delete;
+			aq_batch_awaitable &operator =(const aq_batch_awaitable &) = delete;
+
+			void add(T &&value)
+			{
+				out.push_back(std::move(value));
+				++count;
+			}
+
+			template<class Queue>
+			void take(Queue &queue)
+			{
+				while (count < max && !queue.empty())
+				{
+					add(std::move(queue.front()));
+					queue.pop();
+				}
+			}
+
+			bool full() const noexcept
+			{
+				return count == max;
+			}
+
+			void set_exception(std::exception_ptr ptr) noexcept
+			{
+				exception = std::move(ptr);
+			}
+
+			bool await_ready()
+			{
+				return master->is_batch_ready(this);
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle_)
+			{
+				handle = handle_;
+				return master->set_batch_awaitable(this);
+			}
+
+			// Returns the number of values appended to out
+			size_t await_resume()
+			{
+				if (exception) [[unlikely]]
+					std::rethrow_exception(exception);
+				return count;
+			}
+		};
+
+		// Scheduler is either a callback policy or an executor used to resume the consumer
+		template<class T, class Queue = std::queue<T>, class Scheduler = callback_policy::empty>
 		class async_queue
 		{
 			using queue_t = Queue;
 			using awaitable = aq_awaitable<async_queue, T>;
+			using batch_awaitable = aq_batch_awaitable<async_queue, T>;
+			using executor_type = executor_t<Scheduler>;
 			friend typename awaitable;
+			friend typename batch_awaitable;
 
 			mutable srwlock queue_lock;
 			queue_t queue;
 			awaitable *current{ nullptr };
+			batch_awaitable *current_batch{ nullptr };	// only one of current and current_batch is set
 			std::exception_ptr exception{};
+			[[no_unique_address]] executor_type executor;
 
 			bool is_ready(std::variant<std::monostate, std::exception_ptr, T> &value) noexcept
 			{
@@ -112,10 +185,52 @@ namespace corsl
 				return true;
 			}
 
-			void drain([[maybe_unused]] std::unique_lock<srwlock> &&lock)
+			bool is_batch_ready(batch_awaitable *pointer)
 			{
-				lock;
-				if (current)
+				std::scoped_lock l{ queue_lock };
+				if (exception) [[unlikely]]
+				{
+					pointer->set_exception(exception);
+					return true;
+				}
+				if (!queue.empty() || !pointer->max)
+				{
+					pointer->take(queue);
+					return true;
+				}
+				return false;
+			}
+
+			bool set_batch_awaitable(batch_awaitable *pointer)
+			{
+				std::scoped_lock l{ queue_lock };
+				if (exception) [[unlikely]]
+					std::rethrow_exception(exception);
+				if (!queue.empty())
+				{
+					pointer->take(queue);
+					return false;
+				}
+				current_batch = pointer;
+				return true;
+			}
+
+			// The consumer is resumed after the lock is released, as an inline executor may run it right away
+			void drain(std::unique_lock<srwlock> lock)
+			{
+				if (!exception && queue.empty())
+					return;
+				std::coroutine_handle<> handle;
+				if (current_batch)
+				{
+					auto cur = std::exchange(current_batch, nullptr);
+					if (exception) [[unlikely]]
+						cur->set_exception(exception);
+					else
+						cur->take(queue);
+					handle = cur->handle;
+				}
+				else if (current)
 				{
 					auto cur = std::exchange(current, nullptr);
 					if (exception) [[unlikely]]
@@ -126,8 +241,11 @@ namespace corsl
 						cur->set_result(std::move(v));
 						queue.pop();
 					}
-					resume_on_background<CallbackPolicy>(cur->handle);
+					handle = cur->handle;
 				}
+				lock.unlock();
+				if (handle)
+					executor.schedule(handle);
 			}
 
 		public:
@@ -136,12 +254,23 @@ namespace corsl
 
 			async_queue() = default;
 
+			explicit async_queue(const executor_type &executor) :
+				executor{ executor }
+			{}
+
 			template<class Alloc>
 				requires std::uses_allocator_v<Queue, Alloc>
 			explicit async_queue(const Alloc &alloc) :
 				queue{ alloc }
 			{}
 
+			template<class Alloc>
+				requires std::uses_allocator_v<Queue, Alloc>
+			async_queue(const executor_type &executor, const Alloc &alloc) :
+				queue{ alloc },
+				executor{ executor }
+			{}
+
 			template<class V>
 			size_t push(V &&item)
 			{
@@ -164,6 +293,21 @@ namespace corsl
 				return retval;
 			}
 
+			// Adds all values from the range, a waiting consumer is resumed once
+			template<std::ranges::input_range Range>
+			size_t push_range(Range &&range)
+			{
+				std::unique_lock l{ queue_lock };
+				if (!exception) [[likely]]
+				{
+					for (auto &&item : range)
+						queue.emplace(std::forward<decltype(item)>(item));
+				}
+				auto retval = queue.size();
+				drain(std::move(l));
+				return retval;
+			}
+
 			void cancel()
 			{
 				std::unique_lock l{ queue_lock };
@@ -183,6 +327,13 @@ namespace corsl
 				return{ this };
 			}
 
+			// Waits until the queue is not empty and appends up to max values to out under a single lock.
+			// Produces the number of values appended
+			batch_awaitable next_batch(size_t max, std::vector<T> &out) noexcept
+			{
+				return{ this, max, out };
+			}
+
 			void clear() noexcept
 			{
 				queue_t empty_queue;
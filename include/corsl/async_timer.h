@@ -15,21 +15,29 @@ namespace corsl
 {
 	namespace details
 	{
-		template<class CallbackPolicy = callback_policy::empty>
+		// Scheduler is either a callback policy or an executor used to resume the waiting coroutine
+		template<class Scheduler = callback_policy::empty>
 		class async_timer
 		{
+			using executor_type = executor_t<Scheduler>;
+			using policy_type = callback_policy_t<Scheduler>;
+
+			// Timer callback already runs on the thread pool, other executors get the continuation handed over
+			static constexpr bool schedule_on_expiry = !std::is_same_v<executor_type, thread_pool_executor<policy_type>>;
+
 			winrt::handle_type<timer_traits> timer
 			{
 				CreateThreadpoolTimer([](PTP_CALLBACK_INSTANCE pci, void * context, PTP_TIMER) noexcept
 			{
-				CallbackPolicy::init_callback(pci);
-				static_cast<async_timer *>(context)->resume(false);
+				policy_type::init_callback(pci);
+				static_cast<async_timer *>(context)->resume(schedule_on_expiry);
 			}, this, nullptr)
 			};
 
 			srwlock lock;
 			std::coroutine_handle<> resume_location{};
 			bool cancellation_requested{ false };
+			[[no_unique_address]] executor_type executor;
 
 			//
 			void resume(bool background) noexcept
@@ -39,80 +47,92 @@ namespace corsl
 				{
 					l.unlock();
 					if (background)
-						resume_on_background<CallbackPolicy>(continuation);
+						executor.schedule(continuation);
 					else
 						continuation();
 				}
 			}
 
-			void check_cancellation(std::unique_lock<srwlock> &l)
-			{
-				if (cancellation_requested) [[unlikely]]
-				{
-					cancellation_requested = false;
-					l.unlock();
-					throw timer_cancelled{};
-				}
-			}
-
-			void check_exception()
+			bool take_cancellation() noexcept
 			{
-				lock.lock();
-				if (cancellation_requested) [[unlikely]]
-				{
-					cancellation_requested = false;
-					lock.unlock();
-					throw timer_cancelled{};
-				}
-				else
-					lock.unlock();
+				std::scoped_lock l{ lock };
+				return std::exchange(cancellation_requested, false);
 			}
 
-			void suspend(std::coroutine_handle<> handle, winrt::Windows::Foundation::TimeSpan duration)
+			// Returns false without suspending if the timer has been cancelled
+			bool suspend(std::coroutine_handle<> handle, winrt::Windows::Foundation::TimeSpan duration) noexcept
 			{
 				{
-					std::unique_lock l{ lock };
-					check_cancellation(l);
+					std::scoped_lock l{ lock };
+					if (cancellation_requested) [[unlikely]]
+						return false;
 					assert(!resume_location);
 					resume_location = handle;
 				}
 				int64_t relative_count = -duration.count();
 				SetThreadpoolTimer(timer.get(), reinterpret_cast<PFILETIME>(&relative_count), 0, 0);
+				return true;
 			}
 
-		public:
-			auto wait(winrt::Windows::Foundation::TimeSpan duration) noexcept
+			// Non-throwing awaiter reports cancellation as std::expected error
+			template<bool nothrow>
+			class awaiter
 			{
-				class awaiter
-				{
-					async_timer *timer;
-					winrt::Windows::Foundation::TimeSpan duration;
+				async_timer *timer;
+				winrt::Windows::Foundation::TimeSpan duration;
 
-				public:
-					awaiter(async_timer *timer, winrt::Windows::Foundation::TimeSpan duration) noexcept :
-						timer{ timer },
-						duration{ duration }
-					{}
+			public:
+				awaiter(async_timer *timer, winrt::Windows::Foundation::TimeSpan duration) noexcept :
+					timer{ timer },
+					duration{ duration }
+				{}
 
-					bool await_ready() const noexcept
-					{
-						return duration.count() <= 0;
-					}
+				bool await_ready() const noexcept
+				{
+					return duration.count() <= 0;
+				}
 
-					void await_suspend(std::coroutine_handle<> handle) noexcept
-					{
-						timer->suspend(handle, duration);
-					}
+				bool await_suspend(std::coroutine_handle<> handle) noexcept
+				{
+					return timer->suspend(handle, duration);
+				}
 
-					void await_resume() const
+				auto await_resume() const noexcept(nothrow)
+				{
+					if constexpr (nothrow)
 					{
-						timer->check_exception();
+						if (timer->take_cancellation()) [[unlikely]]
+							return std::expected<void, HRESULT>{ std::unexpect, cancellation_error<HRESULT>::get() };
+						return std::expected<void, HRESULT>{};
 					}
-				};
+					else if (timer->take_cancellation()) [[unlikely]]
+						throw timer_cancelled{};
+				}
+			};
 
+			template<bool nothrow>
+			awaiter<nothrow> iwait(winrt::Windows::Foundation::TimeSpan duration) noexcept
+			{
 				std::scoped_lock l{ lock };
 				cancellation_requested = false;
-				return awaiter{ this,duration };
+				return { this, duration };
+			}
+
+		public:
+			async_timer() = default;
+
+			explicit async_timer(const executor_type &executor) noexcept :
+				executor{ executor }
+			{}
+
+			auto wait(winrt::Windows::Foundation::TimeSpan duration) noexcept
+			{
+				return iwait<false>(duration);
+			}
+
+			auto wait(winrt::Windows::Foundation::TimeSpan duration, std::nothrow_t) noexcept
+			{
+				return iwait<true>(duration);
 			}
 
 			void cancel() noexcept
@@ -132,8 +152,8 @@ namespace corsl
 		};
 	}
 
-	template<class CallbackPolicy>
-	using async_timer_ex = details::async_timer<CallbackPolicy>;
+	template<class Scheduler>
+	using async_timer_ex = details::async_timer<Scheduler>;
 
 	using async_timer = details::async_timer<>;
 }
@@ -0,0 +1,316 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <boost/intrusive/list.hpp>
+
+#include "async_queue.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		namespace bi = boost::intrusive;
+
+		template<class Master, class T>
+		struct bq_push_awaitable : public bi::list_base_hook<bi::link_mode<bi::normal_link>>
+		{
+			std::coroutine_handle<> handle;
+			Master *master;
+			T value;
+			std::exception_ptr exception{};
+
+			template<class...Args>
+			bq_push_awaitable(Master *master, Args &&...args) :
+				master{ master },
+				value(std::forward<Args>(args)...)
+			{}
+
+			// no move and copy
+			bq_push_awaitable(const bq_push_awaitable &) = delete;
+			bq_push_awaitable &operator =(const bq_push_awaitable &) = delete;
+
+			bool await_ready()
+			{
+				return master->try_put(this);
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle_)
+			{
+				handle = handle_;
+				return master->set_producer(this);
+			}
+
+			void await_resume() const
+			{
+				if (exception) [[unlikely]]
+					std::rethrow_exception(exception);
+			}
+		};
+
+		// Queue of at most capacity values stored in a ring buffer. Producers awaiting push are suspended while the
+		// queue is full, consumers awaiting next are suspended while it is empty. Both are resumed in FIFO order and
+		// a value is handed off under the lock, so a woken producer or consumer never has to retry.
+		// Scheduler is either a callback policy or an executor used to resume producers and consumers
+		template<class T, class Scheduler = callback_policy::empty>
+		class bounded_async_queue
+		{
+			using executor_type = executor_t<Scheduler>;
+			struct awaitable_base : public bi::list_base_hook<bi::link_mode<bi::normal_link>>
+			{
+			};
+
+			using awaitable = aq_awaitable<bounded_async_queue, T, awaitable_base>;
+			using push_awaitable = bq_push_awaitable<bounded_async_queue, T>;
+			friend typename awaitable;
+			friend typename push_awaitable;
+
+			mutable srwlock queue_lock;
+			std::vector<std::optional<T>> slots;
+			size_t first{};
+			size_t count{};
+			bi::list<awaitable> consumers;	// waiting while the queue is empty
+			bi::list<push_awaitable> producers;	// waiting while the queue is full
+			std::exception_ptr exception{};
+			[[no_unique_address]] executor_type executor;
+
+			// Called with the lock held
+			template<class V>
+			void store(V &&value)
+			{
+				slots[(first + count) % slots.size()].emplace(std::forward<V>(value));
+				++count;
+			}
+
+			// Called with the lock held. Returns a waiting consumer that has received the value, the caller resumes
+			// it after releasing the lock
+			template<class V>
+			awaitable *put(V &&value)
+			{
+				if (!consumers.empty())
+				{
+					auto &consumer = consumers.front();
+					consumers.pop_front();
+					consumer.set_result(T(std::forward<V>(value)));
+					return &consumer;
+				}
+				store(std::forward<V>(value));
+				return nullptr;
+			}
+
+			// Called with the lock held. A slot has been freed, so the first waiting producer is let in
+			push_awaitable *admit_producer()
+			{
+				if (producers.empty())
+					return nullptr;
+				auto &producer = producers.front();
+				producers.pop_front();
+				store(std::move(producer.value));
+				return &producer;
+			}
+
+			// Called with the lock held
+			bool is_full() const noexcept
+			{
+				return count == slots.size();
+			}
+
+			// Called with the lock held. Returns false, keeping the lock, if the producer has to wait for a free slot
+			bool put_or_fail(push_awaitable *pointer, std::unique_lock<srwlock> &l)
+			{
+				if (exception) [[unlikely]]
+				{
+					pointer->exception = exception;
+					return true;
+				}
+				if (is_full())
+					return false;
+				auto consumer = put(std::move(pointer->value));
+				l.unlock();
+				if (consumer)
+					executor.schedule(consumer->handle);
+				return true;
+			}
+
+			bool try_put(push_awaitable *pointer)
+			{
+				std::unique_lock l{ queue_lock };
+				return put_or_fail(pointer, l);
+			}
+
+			bool set_producer(push_awaitable *pointer)
+			{
+				std::unique_lock l{ queue_lock };
+				if (put_or_fail(pointer, l))
+					return false;
+				producers.push_back(*pointer);
+				return true;
+			}
+
+			// Called with the lock held. Returns false, keeping the lock, if the queue is empty
+			bool take(std::variant<std::monostate, std::exception_ptr, T> &value, std::unique_lock<srwlock> &l)
+			{
+				if (!count)
+					return false;
+				auto &slot = slots[first];
+				value = std::move(*slot);
+				slot.reset();
+				first = (first + 1) % slots.size();
+				--count;
+				auto producer = admit_producer();
+				l.unlock();
+				if (producer)
+					executor.schedule(producer->handle);
+				return true;
+			}
+
+			bool is_ready(std::variant<std::monostate, std::exception_ptr, T> &value)
+			{
+				std::unique_lock l{ queue_lock };
+				if (exception) [[unlikely]]
+				{
+					value = exception;
+					return true;
+				}
+				return take(value, l);
+			}
+
+			bool set_awaitable(awaitable *pointer)
+			{
+				std::unique_lock l{ queue_lock };
+				if (exception) [[unlikely]]
+					std::rethrow_exception(exception);
+				if (take(pointer->value, l))
+					return false;
+				consumers.push_back(*pointer);
+				return true;
+			}
+
+		public:
+			bounded_async_queue(const bounded_async_queue &) = delete;
+			bounded_async_queue &operator =(const bounded_async_queue &) = delete;
+
+			// Capacity of zero is treated as one
+			explicit bounded_async_queue(size_t capacity) :
+				slots(std::max<size_t>(capacity, 1))
+			{}
+
+			bounded_async_queue(size_t capacity, const executor_type &executor) :
+				slots(std::max<size_t>(capacity, 1)),
+				executor{ executor }
+			{}
+
+			// The returned awaitable completes when the value is stored in the queue or handed to a consumer.
+			// It throws the queue's exception if the queue has been cancelled before or while waiting
+			template<class V>
+			[[nodiscard]]
+			push_awaitable push(V &&item)
+			{
+				return { this, std::forward<V>(item) };
+			}
+
+			template<class...Args>
+			[[nodiscard]]
+			push_awaitable emplace(Args &&...args)
+			{
+				return { this, std::forward<Args>(args)... };
+			}
+
+			// Returns false without consuming the item if the queue is full or cancelled
+			template<class V>
+			bool try_push(V &&item)
+			{
+				std::unique_lock l{ queue_lock };
+				if (exception || is_full())
+					return false;
+				auto consumer = put(std::forward<V>(item));
+				l.unlock();
+				if (consumer)
+					executor.schedule(consumer->handle);
+				return true;
+			}
+
+			void cancel()
+			{
+				push_exception(std::make_exception_ptr(operation_cancelled{}));
+			}
+
+			// Waiting consumers and producers are resumed with the exception, subsequent push calls throw it
+			void push_exception(std::exception_ptr exception_)
+			{
+				decltype(consumers) consumers_copy;
+				decltype(producers) producers_copy;
+
+				{
+					std::scoped_lock l{ queue_lock };
+					exception = exception_;
+					consumers.swap(consumers_copy);
+					producers.swap(producers_copy);
+				}
+
+				std::vector<std::coroutine_handle<>> handles;
+				handles.reserve(consumers_copy.size() + producers_copy.size());
+				for (auto &consumer : consumers_copy)
+				{
+					consumer.set_exception(exception_);
+					handles.push_back(consumer.handle);
+				}
+				for (auto &producer : producers_copy)
+				{
+					producer.exception = exception_;
+					handles.push_back(producer.handle);
+				}
+				schedule_bulk(executor, handles);
+			}
+
+			awaitable next() noexcept
+			{
+				return{ this };
+			}
+
+			// Removes all values and the exception, waiting producers are let in
+			void clear()
+			{
+				std::vector<std::coroutine_handle<>> handles;
+				{
+					std::scoped_lock l{ queue_lock };
+					for (auto &slot : slots)
+						slot.reset();
+					first = count = 0;
+					exception = {};
+					while (!is_full() && !producers.empty())
+						handles.push_back(admit_producer()->handle);
+				}
+				schedule_bulk(executor, handles);
+			}
+
+			[[nodiscard]]
+			bool empty() const noexcept
+			{
+				std::shared_lock l{ queue_lock };
+				return !count;
+			}
+
+			[[nodiscard]]
+			auto size() const noexcept
+			{
+				std::shared_lock l{ queue_lock };
+				return count;
+			}
+
+			[[nodiscard]]
+			auto capacity() const noexcept
+			{
+				return slots.size();
+			}
+		};
+	}
+
+	using details::bounded_async_queue;
+}
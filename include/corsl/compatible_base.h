@@ -10,8 +10,10 @@
 
 #include "impl/dependencies.h"
 #include "impl/errors.h"
+#include "impl/frame_allocator.h"
 
 #include "thread_pool.h"
+#include "work_stealing_pool.h"
 
 namespace corsl
 {
@@ -49,17 +51,194 @@ namespace corsl
 			};
 		}
 
-		template<class CallbackPolicy>
-		inline void resume_on_background(std::coroutine_handle<> handle, PTP_CALLBACK_ENVIRON env = nullptr)
+		// Executors
+		// An executor is a small copyable object that schedules resumption of a coroutine handle. Library classes that
+		// are templated on CallbackPolicy also accept an executor type in its place. Executors that cannot fail to submit
+		// work should declare schedule noexcept
+		template<class E>
+		concept executor = std::copy_constructible<E> && requires(const E &e, std::coroutine_handle<> handle)
+		{
+			e.schedule(handle);
+		};
+
+		// Executor that is able to accept a whole batch of handles in one operation
+		template<class E>
+		concept bulk_executor = executor<E> && requires(const E &e, std::span<const std::coroutine_handle<>> handles)
+		{
+			e.schedule_bulk(handles);
+		};
+
+		template<executor E>
+		inline void schedule_bulk(const E &e, std::span<const std::coroutine_handle<>> handles)
+		{
+			if constexpr (bulk_executor<E>)
+				e.schedule_bulk(handles);
+			else
+				for (auto handle : handles)
+					e.schedule(handle);
+		}
+
+		// A batch of handles shared by several thread pool callbacks, each callback claims handles until the batch is exhausted
+		struct bulk_batch
+		{
+			std::vector<std::coroutine_handle<>> handles;
+			std::atomic<size_t> next{ 0 };
+			std::atomic<unsigned> refs;
+
+			bulk_batch(std::span<const std::coroutine_handle<>> handles, unsigned refs) :
+				handles{ handles.begin(), handles.end() },
+				refs{ refs }
+			{}
+
+			// A callback that moves on to a further handle tells the pool it may run long, so the pool can add threads
+			// if one of the resumed coroutines blocks
+			void run(PTP_CALLBACK_INSTANCE pci) noexcept
+			{
+				bool may_run_long = false;
+				for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < handles.size();)
+				{
+					if (may_run_long)
+						CallbackMayRunLong(pci);
+					may_run_long = true;
+					handles[i]();
+				}
+			}
+
+			void release(unsigned count = 1) noexcept
+			{
+				if (refs.fetch_sub(count, std::memory_order_acq_rel) == count)
+					delete this;
+			}
+		};
+
+		inline unsigned get_bulk_width() noexcept
 		{
-			if (!TrySubmitThreadpoolCallback([](PTP_CALLBACK_INSTANCE pci, void *context)
+			static const unsigned width = std::max(std::thread::hardware_concurrency(), 1u);
+			return width;
+		}
+
+		// Submits work to Windows thread pool
+		// Define CORSL_USE_WORK_STEALING_POOL to direct resumptions that do not specify callback environment
+		// to the process-wide work_stealing_pool instead of the process default Windows thread pool. Resumptions with
+		// a callback policy or the long-running hint stay on Windows thread pool, which provides the callback instance
+		// the policy needs and adds threads for long-running callbacks
+		template<class CallbackPolicy = callback_policy::empty, bool is_long = false>
+		struct thread_pool_executor
+		{
+			using policy_type = CallbackPolicy;
+
+#if defined(CORSL_USE_WORK_STEALING_POOL)
+			static constexpr bool use_work_stealing_pool = std::same_as<CallbackPolicy, callback_policy::empty> && !is_long;
+#else
+			static constexpr bool use_work_stealing_pool = false;
+#endif
+
+			PTP_CALLBACK_ENVIRON env{};
+
+			void schedule(std::coroutine_handle<> handle) const
+			{
+				if constexpr (use_work_stealing_pool)
 				{
+					if (!env)
+						return work_stealing_pool::get_default().schedule(handle);
+				}
+				auto callback = [](PTP_CALLBACK_INSTANCE pci, void *context)
+				{
+					if constexpr (is_long)
+						CallbackMayRunLong(pci);
 					CallbackPolicy::init_callback(pci);
 					std::coroutine_handle<>::from_address(context)();
-				}, handle.address(), env)) [[unlikely]]
-				{
+				};
+
+				if (!TrySubmitThreadpoolCallback(callback, handle.address(), env)) [[unlikely]]
 					throw_last_error();
+			}
+
+			// Submits at most one callback per hardware thread, the callbacks share the batch. Coroutines in the batch
+			// must not block waiting for each other: a blocked callback does not process the rest of the batch
+			void schedule_bulk(std::span<const std::coroutine_handle<>> handles) const
+			{
+				if (handles.size() < 2)
+				{
+					for (auto handle : handles)
+						schedule(handle);
+					return;
+				}
+				if constexpr (use_work_stealing_pool)
+				{
+					if (!env)
+						return work_stealing_pool::get_default().schedule_bulk(handles);
+				}
+				auto callback = [](PTP_CALLBACK_INSTANCE pci, void *context)
+				{
+					if constexpr (is_long)
+						CallbackMayRunLong(pci);
+					CallbackPolicy::init_callback(pci);
+					auto batch = static_cast<bulk_batch *>(context);
+					batch->run(pci);
+					batch->release();
+				};
+
+				const auto width = static_cast<unsigned>(std::min<size_t>(handles.size(), get_bulk_width()));
+				auto batch = new bulk_batch{ handles, width };
+				for (unsigned i = 0; i < width; ++i)
+				{
+					if (!TrySubmitThreadpoolCallback(callback, batch, env)) [[unlikely]]
+					{
+						// Callbacks that were already submitted will process the whole batch
+						const auto error = GetLastError();
+						batch->release(width - i);
+						if (!i)
+							throw_win32_error(error);
+						return;
+					}
 				}
+			}
+		};
+
+		// Resumes the coroutine on the calling thread
+		struct inline_executor
+		{
+			static void schedule(std::coroutine_handle<> handle) noexcept
+			{
+				handle();
+			}
+		};
+
+		// Maps a template argument, which is either a callback policy or an executor, to an executor type and
+		// a callback policy used for Windows thread pool callbacks
+		template<class Scheduler>
+		struct scheduler_traits
+		{
+			using executor_type = thread_pool_executor<Scheduler>;
+			using policy_type = Scheduler;
+		};
+
+		template<executor Scheduler>
+		struct scheduler_traits<Scheduler>
+		{
+			using executor_type = Scheduler;
+			using policy_type = callback_policy::empty;
+		};
+
+		template<executor Scheduler>
+			requires requires { typename Scheduler::policy_type; }
+		struct scheduler_traits<Scheduler>
+		{
+			using executor_type = Scheduler;
+			using policy_type = typename Scheduler::policy_type;
+		};
+
+		template<class Scheduler>
+		using executor_t = typename scheduler_traits<Scheduler>::executor_type;
+
+		template<class Scheduler>
+		using callback_policy_t = typename scheduler_traits<Scheduler>::policy_type;
+
+		template<class CallbackPolicy>
+		inline void resume_on_background(std::coroutine_handle<> handle, PTP_CALLBACK_ENVIRON env = nullptr)
+		{
+			thread_pool_executor<CallbackPolicy>{ env }.schedule(handle);
 		}
 
 		inline void resume_on_background(std::coroutine_handle<> handle, PTP_CALLBACK_ENVIRON env = nullptr)
@@ -67,6 +246,40 @@ namespace corsl
 			resume_on_background<callback_policy::empty>(handle, env);
 		}
 
+		template<executor E>
+		inline void resume_on_background(std::coroutine_handle<> handle, const E &e)
+		{
+			e.schedule(handle);
+		}
+
+		inline void resume_on_background(std::coroutine_handle<> handle, work_stealing_pool &pool)
+		{
+			pool.schedule(handle);
+		}
+
+		// Bulk versions submit a whole batch of handles in one operation
+		template<class CallbackPolicy>
+		inline void resume_on_background(std::span<const std::coroutine_handle<>> handles, PTP_CALLBACK_ENVIRON env = nullptr)
+		{
+			thread_pool_executor<CallbackPolicy>{ env }.schedule_bulk(handles);
+		}
+
+		inline void resume_on_background(std::span<const std::coroutine_handle<>> handles, PTP_CALLBACK_ENVIRON env = nullptr)
+		{
+			resume_on_background<callback_policy::empty>(handles, env);
+		}
+
+		template<executor E>
+		inline void resume_on_background(std::span<const std::coroutine_handle<>> handles, const E &e)
+		{
+			schedule_bulk(e, handles);
+		}
+
+		inline void resume_on_background(std::span<const std::coroutine_handle<>> handles, work_stealing_pool &pool)
+		{
+			pool.schedule_bulk(handles);
+		}
+
 		template<bool is_long = false, class CallbackPolicy = callback_policy::empty>
 		struct __declspec(empty_bases) resume_background_
 		{
@@ -81,16 +294,7 @@ namespace corsl
 
 			void await_suspend(std::coroutine_handle<> handle) const
 			{
-				auto callback = [](PTP_CALLBACK_INSTANCE pci, void * context)
-				{
-					if constexpr (is_long)
-						CallbackMayRunLong(pci);
-					CallbackPolicy::init_callback(pci);
-					std::coroutine_handle<>::from_address(context)();
-				};
-
-				if (!TrySubmitThreadpoolCallback(callback, handle.address(), nullptr)) [[unlikely]]
-					throw_last_error();
+				thread_pool_executor<CallbackPolicy, is_long>{}.schedule(handle);
 			}
 		};
 
@@ -106,16 +310,23 @@ namespace corsl
 
 			void await_suspend(std::coroutine_handle<> handle) const
 			{
-				auto callback = [](PTP_CALLBACK_INSTANCE pci, void * context)
-				{
-					if constexpr (is_long)
-						CallbackMayRunLong(pci);
-					CallbackPolicy::init_callback(pci);
-					std::coroutine_handle<>::from_address(context)();
-				};
+				thread_pool_executor<CallbackPolicy, is_long>{ env }.schedule(handle);
+			}
+		};
 
-				if (!TrySubmitThreadpoolCallback(callback, handle.address(), env)) [[unlikely]]
-					throw_last_error();
+		// A version that resumes on a given executor
+		template<executor E>
+		struct __declspec(empty_bases) executor_resume_background_ : resume_background_<>
+		{
+			E e;
+
+			executor_resume_background_(const E &e) noexcept(std::is_nothrow_copy_constructible_v<E>) :
+				e{ e }
+			{}
+
+			void await_suspend(std::coroutine_handle<> handle) const noexcept(noexcept(e.schedule(handle)))
+			{
+				e.schedule(handle);
 			}
 		};
 
@@ -163,6 +374,17 @@ namespace corsl
 			return resume_background_long<callback_policy::empty>(ce);
 		}
 
+		template<executor E>
+		inline auto resume_background(const E &e) noexcept(std::is_nothrow_copy_constructible_v<E>)
+		{
+			return executor_resume_background_<E>{ e };
+		}
+
+		inline auto resume_background(work_stealing_pool &pool) noexcept
+		{
+			return resume_background(pool.get_executor());
+		}
+
 		// Tmers
 
 		struct timer_traits
@@ -318,6 +540,25 @@ namespace corsl
 			OVERLAPPED m_overlapped{};
 			uint32_t m_result{};
 			std::coroutine_handle<> m_resume{ nullptr };
+
+			// Non-throwing variant reports errors as std::expected
+			template<bool nothrow>
+			auto get_result() const noexcept(nothrow)
+			{
+				const auto transferred = static_cast<uint32_t>(m_overlapped.InternalHigh);
+				if constexpr (nothrow)
+				{
+					if (m_result != NO_ERROR && m_result != ERROR_HANDLE_EOF) [[unlikely]]
+						return std::expected<uint32_t, HRESULT>{ std::unexpect, HRESULT_FROM_WIN32(m_result) };
+					return std::expected<uint32_t, HRESULT>{ transferred };
+				}
+				else
+				{
+					if (m_result != ERROR_HANDLE_EOF)
+						check_win32(m_result);
+					return transferred;
+				}
+			}
 		};
 
 		template<class CallbackPolicy = callback_policy::empty>
@@ -330,8 +571,9 @@ namespace corsl
 			{
 			}
 
-			template <class F>
-			auto start(F &&callback)
+		private:
+			template<bool nothrow, class F>
+			auto istart(F &&callback)
 			{
 				struct awaitable : awaitable_base<CallbackPolicy>, F
 				{
@@ -361,12 +603,9 @@ namespace corsl
 						}
 					}
 
-					uint32_t await_resume() const
+					auto await_resume() const noexcept(nothrow)
 					{
-						if (this->m_result != ERROR_HANDLE_EOF)
-							check_win32(this->m_result);
-
-						return static_cast<uint32_t>(this->m_overlapped.InternalHigh);
+						return this->template get_result<nothrow>();
 					}
 
 					PTP_IO m_io = nullptr;
@@ -375,8 +614,8 @@ namespace corsl
 				return awaitable(get(), std::move(callback));
 			}
 
-			template<class F>
-			auto start_pending(F &&callback)
+			template<bool nothrow, class F>
+			auto istart_pending(F &&callback)
 			{
 				struct awaitable : awaitable_base<CallbackPolicy>, F
 				{
@@ -413,12 +652,9 @@ namespace corsl
 						}
 					}
 
-					uint32_t await_resume() const
+					auto await_resume() const noexcept(nothrow)
 					{
-						if (this->m_result != ERROR_HANDLE_EOF)
-							check_win32(this->m_result);
-
-						return static_cast<uint32_t>(this->m_overlapped.InternalHigh);
+						return this->template get_result<nothrow>();
 					}
 
 					PTP_IO m_io = nullptr;
@@ -427,6 +663,32 @@ namespace corsl
 				return awaitable(get(), std::move(callback));
 			}
 
+		public:
+			template<class F>
+			auto start(F &&callback)
+			{
+				return istart<false>(std::forward<F>(callback));
+			}
+
+			// I/O errors are reported as std::expected<uint32_t, HRESULT> instead of exceptions
+			template<class F>
+			auto start(std::nothrow_t, F &&callback)
+			{
+				return istart<true>(std::forward<F>(callback));
+			}
+
+			template<class F>
+			auto start_pending(F &&callback)
+			{
+				return istart_pending<false>(std::forward<F>(callback));
+			}
+
+			template<class F>
+			auto start_pending(std::nothrow_t, F &&callback)
+			{
+				return istart_pending<true>(std::forward<F>(callback));
+			}
+
 			PTP_IO get() const noexcept
 			{
 				return m_io.get();
@@ -443,7 +705,7 @@ namespace corsl
 		template<bool noexcept_ = false>
 		struct fire_and_forget
 		{
-			struct promise_type
+			struct __declspec(empty_bases) promise_type : frame_allocation_base
 			{
 				fire_and_forget get_return_object() const noexcept
 				{
@@ -545,6 +807,12 @@ namespace corsl
 	using details::resume_background_long;
 	using details::resume_on_background;
 
+	using details::executor;
+	using details::bulk_executor;
+	using details::schedule_bulk;
+	using details::thread_pool_executor;
+	using details::inline_executor;
+
 	using fire_and_forget = details::fire_and_forget<false>;
 	using fire_and_forget_noexcept = details::fire_and_forget<true>;
 
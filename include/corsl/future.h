@@ -12,7 +12,6 @@
 #include "impl/errors.h"
 #include "impl/promise_base.h"
 
-#include "srwlock.h"
 #include "compatible_base.h"
 
 namespace corsl
@@ -22,46 +21,196 @@ namespace corsl
 		template<class T = void>
 		class future;
 
+		// Completion state of a future is a single atomic word. It holds one of the special values below,
+		// an address of the awaiting coroutine (continuation-installed state) or an address of a completion_node
+		// tagged with the lowest bit
+		inline constexpr uintptr_t state_empty = 0;
+		inline constexpr uintptr_t state_ready = 1;
+		inline constexpr uintptr_t state_detached = 2;	// future has been destroyed
+		inline constexpr uintptr_t state_node_tag = 1;
+
+		// Resumes the coroutine on the calling thread if the executor fails to schedule it
+		template<executor E>
+		inline void schedule_or_resume(const E &e, std::coroutine_handle<> handle) noexcept
+		{
+			try
+			{
+				e.schedule(handle);
+			}
+			catch (...)
+			{
+				handle();
+			}
+		}
+
+		// Runs a completion node on an executor. If the executor fails to accept it, the node runs on the calling thread
+		template<executor E>
+		inline fire_and_forget<> run_node_on(E e, completion_node *node) noexcept
+		{
+			try
+			{
+				co_await resume_background(e);
+			}
+			catch (...)
+			{
+			}
+			node->on_complete(node);
+		}
+
+		// Lives on the stack of a thread blocked in future::wait
+		struct blocking_waiter : completion_node
+		{
+			std::binary_semaphore signal{ 0 };
+
+			blocking_waiter() noexcept :
+				completion_node{ .on_complete = [](completion_node *node) noexcept { static_cast<blocking_waiter *>(node)->signal.release(); }, .run_inline = true }
+			{}
+		};
+
+		// Number of polls before a thread blocks in future::wait. It adapts to the observed completion latency:
+		// it grows when spinning pays off and shrinks when thread had to block anyway
+		inline constexpr unsigned min_wait_spin = 16;
+		inline constexpr unsigned max_wait_spin = 1024;
+		inline thread_local unsigned wait_spin = 64;
+
 		template<class value_type>
 		struct __declspec(empty_bases)promise_common : promise_base0
 		{
-			mutex lock;
 			std::variant<std::monostate, std::exception_ptr, value_type> value;
-			std::coroutine_handle<> resume{};
+			std::atomic<uintptr_t> state{ state_empty };
 			std::atomic<int> use_count{ 0 };
 
-			bool is_ready(std::unique_lock<mutex> &) const noexcept
+			// Called with the state replaced by publishing the value. Runs a completion node or returns a continuation to resume
+			static std::coroutine_handle<> get_continuation(uintptr_t state_) noexcept
+			{
+				if (state_ <= state_detached)
+					return {};
+				if (state_ & state_node_tag)
+				{
+					const auto node = reinterpret_cast<completion_node *>(state_ & ~state_node_tag);
+					node->on_complete(node);
+					return {};
+				}
+				return std::coroutine_handle<>::from_address(reinterpret_cast<void *>(state_));
+			}
+
+			bool is_ready() const noexcept
+			{
+				return state.load(std::memory_order_acquire) == state_ready;
+			}
+
+			// Installs a continuation, returns false if the value is already available
+			bool set_continuation(std::coroutine_handle<> resume) noexcept
+			{
+				auto expected = state_empty;
+				if (state.compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(resume.address()), std::memory_order_release, std::memory_order_acquire))
+					return true;
+				assert(expected == state_ready && "future cannot be awaited multiple times");
+				return false;
+			}
+
+			bool spin_until_ready() const noexcept
+			{
+				const auto limit = wait_spin;
+				for (unsigned i = 0; i < limit; ++i)
+				{
+					if (is_ready())
+					{
+						wait_spin = std::min(limit * 2, max_wait_spin);
+						return true;
+					}
+					if (i >= limit / 2)
+						std::this_thread::yield();
+				}
+				wait_spin = std::max(limit / 2, min_wait_spin);
+				return false;
+			}
+
+			// Installs a completion node, returns false if the value is already available
+			bool set_node(completion_node &node) noexcept
+			{
+				auto expected = state_empty;
+				if (state.compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(&node) | state_node_tag, std::memory_order_release, std::memory_order_acquire))
+					return true;
+				assert(expected == state_ready && "future cannot be awaited multiple times");
+				return false;
+			}
+
+			// Blocks calling thread until the value is published. Does not allocate
+			void wait() noexcept
 			{
-				return value.index() != 0;
+				if (spin_until_ready())
+					return;
+
+				blocking_waiter waiter;
+				if (set_node(waiter))
+					waiter.signal.acquire();
+			}
+
+			// Returns false if the value has not been published before the deadline
+			template<class Clock, class Duration>
+			bool wait_until(const std::chrono::time_point<Clock, Duration> &deadline) noexcept
+			{
+				if (is_ready())
+					return true;
+				if (Clock::now() >= deadline || spin_until_ready())
+					return is_ready();
+
+				blocking_waiter waiter;
+				if (!set_node(waiter) || waiter.signal.try_acquire_until(deadline))
+					return true;
+
+				// Timed out, take the waiter back. If that fails, the value is being published right now
+				// and the waiter must not leave until it is signaled
+				auto expected = reinterpret_cast<uintptr_t>(static_cast<completion_node *>(&waiter)) | state_node_tag;
+				if (state.compare_exchange_strong(expected, state_empty, std::memory_order_acquire, std::memory_order_acquire))
+					return false;
+				waiter.signal.acquire();
+				return true;
 			}
 
-			void check_resume(std::unique_lock<mutex> &&l) noexcept
+			// Publishes the value and resumes the continuation, if any, on a given executor. A completion node runs on
+			// the executor as well. If the executor fails to accept the continuation, it is resumed on the calling thread
+			template<executor E>
+			void complete_on(const E &e) noexcept
 			{
-				if (auto resume_ = std::exchange(resume, std::coroutine_handle<>{}))
+				const auto state_ = state.exchange(state_ready, std::memory_order_acq_rel);
+				if constexpr (!std::same_as<E, inline_executor>)
 				{
-					l.unlock();
-					resume_();
+					if (state_ > state_detached && (state_ & state_node_tag))
+					{
+						const auto node = reinterpret_cast<completion_node *>(state_ & ~state_node_tag);
+						if (!node->run_inline)
+						{
+							run_node_on(e, node);
+							return;
+						}
+					}
 				}
+				if (auto resume_ = get_continuation(state_))
+					schedule_or_resume(e, resume_);
 			}
 
 			void internal_set_exception(std::exception_ptr &&exception) noexcept
 			{
-				lock.lock();	// will be released in final_suspend
-				value = std::move(exception);
+				value = std::move(exception);	// will be published in final_suspend
 			}
 
-			fire_and_forget<> internal_set_exception_async(std::exception_ptr &&exception) noexcept
+			template<executor E>
+			void internal_set_exception_on(const E &e, std::exception_ptr &&exception) noexcept
 			{
-				std::unique_lock<mutex> l{ lock };
 				value = std::move(exception);
-				co_await resume_background();
-				check_resume(std::move(l));
+				complete_on(e);
+			}
+
+			void internal_set_exception_async(std::exception_ptr &&exception) noexcept
+			{
+				internal_set_exception_on(thread_pool_executor<>{}, std::move(exception));
 			}
 
 			void unhandled_exception() noexcept
 			{
-				lock.lock();	// will be released in final_suspend
-				value = std::current_exception();
+				value = std::current_exception();	// will be published in final_suspend
 			}
 
 			void check_exception()
@@ -75,6 +224,14 @@ namespace corsl
 				check_exception();
 				return *std::get_if<value_type>(&value);
 			}
+
+			// Access for multiple readers, the exception is not moved out
+			const value_type &get_shared() const
+			{
+				if (std::holds_alternative<std::exception_ptr>(value)) [[unlikely]]
+					std::rethrow_exception(std::get<std::exception_ptr>(value));
+				return *std::get_if<value_type>(&value);
+			}
 		};
 
 		// future
@@ -84,11 +241,21 @@ namespace corsl
 			template<class V>
 			void return_value(V &&v) noexcept
 			{
-				this->lock.lock();	// will be released in final_suspend
+				this->value = std::forward<V>(v);	// will be published in final_suspend
+			}
+
+			template<executor E, class V>
+			void return_value_on(const E &e, V &&v) noexcept
+			{
 				this->value = std::forward<V>(v);
+				this->complete_on(e);
 			}
 
-			future<> return_value_async(T v) noexcept;
+			template<class V>
+			void return_value_async(V &&v) noexcept
+			{
+				return_value_on(thread_pool_executor<>{}, std::forward<V>(v));
+			}
 		};
 
 		struct empty_type {};
@@ -98,11 +265,20 @@ namespace corsl
 		{
 			void return_void() noexcept
 			{
-				lock.lock();	// will be released in final_suspend::await_ready
+				value = empty_type{};	// will be published in final_suspend
+			}
+
+			template<executor E>
+			void return_void_on(const E &e) noexcept
+			{
 				value = empty_type{};
+				complete_on(e);
 			}
 
-			future<> return_void_async() noexcept;
+			void return_void_async() noexcept
+			{
+				return_void_on(thread_pool_executor<>{});
+			}
 		};
 
 		template<class T>
@@ -131,20 +307,76 @@ namespace corsl
 		};
 
 		template<class T>
-		struct  __declspec(empty_bases) promise_type_ : promise_base<T>
+		struct is_expected : std::false_type
+		{};
+
+		template<class T, class E>
+		struct is_expected<std::expected<T, E>> : std::true_type
+		{};
+
+		template<class T>
+		constexpr bool is_expected_v = is_expected<T>::value;
+
+		// Obtains an awaiter for an expression the same way co_await does
+		template<class Awaitable>
+		decltype(auto) get_awaiter(Awaitable &&awaitable)
 		{
-			std::coroutine_handle<> destroy_resume{};
-			bool future_exists{ true };
+			if constexpr (requires { std::forward<Awaitable>(awaitable).operator co_await(); })
+				return std::forward<Awaitable>(awaitable).operator co_await();
+			else if constexpr (requires { operator co_await(std::forward<Awaitable>(awaitable)); })
+				return operator co_await(std::forward<Awaitable>(awaitable));
+			else
+				return std::forward<Awaitable>(awaitable);
+		}
+
+		// If the coroutine has been cancelled, it is not resumed: the future completes with cancellation error and
+		// the frame is destroyed when the future is released
+		template<class Awaiter, class Promise>
+		struct expected_cancellation_awaiter
+		{
+			Awaiter awaiter;
+			bool cancelled;
 
-			//
-			bool start_async(std::coroutine_handle<> resume_, std::unique_lock<mutex> &&l) noexcept
+			bool await_ready()
 			{
-				if (this->is_ready(l))
-					return false;	// we already have a result
-				assert(!this->resume && "future cannot be awaited multiple times");
-				this->resume = resume_;
-				return true;
+				return !cancelled && awaiter.await_ready();
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle)
+			{
+				if (cancelled) [[unlikely]]
+					return handle.promise().publish_cancelled(handle);
+
+				using result = decltype(awaiter.await_suspend(handle));
+				if constexpr (std::same_as<void, result>)
+				{
+					awaiter.await_suspend(handle);
+					return std::noop_coroutine();
+				}
+				else if constexpr (std::same_as<bool, result>)
+				{
+					if (awaiter.await_suspend(handle))
+						return std::noop_coroutine();
+					return handle;
+				}
+				else
+					return awaiter.await_suspend(handle);
+			}
+
+			decltype(auto) await_resume()
+			{
+				return awaiter.await_resume();
 			}
+		};
+
+		template<class T>
+		struct  __declspec(empty_bases) promise_type_ : promise_base<T>, frame_allocation_base
+		{
+			// Set when coroutine reaches final suspend point, promise objects not backed by a coroutine never set it
+			std::coroutine_handle<> destroy_resume{};
+			// Set for shared states which are not backed by a coroutine (promise<T> and fused continuations), owned by
+			// promise and future objects
+			void (*delete_standalone)(promise_type_ *) noexcept {};
 
 			static std::suspend_never initial_suspend() noexcept
 			{
@@ -155,26 +387,14 @@ namespace corsl
 			{
 				promise_type_ *pthis;
 
-				bool await_ready() const noexcept
+				static bool await_ready() noexcept
 				{
-					auto is_ready = !pthis->future_exists;
-					if (is_ready)
-					{
-						auto resume = std::exchange(pthis->resume, {});
-						pthis->lock.unlock();
-						if (resume)
-							resume();
-					}
-					return is_ready;
+					return false;
 				}
 
-				auto await_suspend(std::coroutine_handle<> resume_) noexcept
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> resume_) noexcept
 				{
-					pthis->destroy_resume = resume_;
-#pragma warning(suppress: 26110)
-					auto result = std::exchange(pthis->resume, {});
-					pthis->lock.unlock();
-					return result ? result : std::noop_coroutine();
+					return pthis->publish(resume_);
 				}
 
 				static void await_resume() noexcept
@@ -187,10 +407,33 @@ namespace corsl
 				return awaiter{ this };
 			}
 
+			// Publishes the value of a coroutine suspended at a given point, it is never resumed from there
+			std::coroutine_handle<> publish(std::coroutine_handle<> suspended) noexcept
+			{
+				destroy_resume = suspended;
+				const auto state = this->state.exchange(state_ready, std::memory_order_acq_rel);
+				// the frame may already be destroyed by the future at this point, do not touch this
+				if (state == state_detached)
+				{
+					suspended.destroy();
+					return std::noop_coroutine();
+				}
+				if (auto continuation = promise_type_::get_continuation(state))
+					return continuation;
+				return std::noop_coroutine();
+			}
+
+			// Completes a coroutine returning std::expected with cancellation error, without throwing
+			std::coroutine_handle<> publish_cancelled(std::coroutine_handle<> suspended) noexcept requires is_expected_v<T>
+			{
+				this->value = T{ std::unexpect, cancellation_error<typename T::error_type>::get() };
+				return publish(suspended);
+			}
+
 			future<T> get_return_object() noexcept
 			{
 				add_ref();
-				return { std::coroutine_handle<promise_type_>::from_promise(*this) };
+				return { this };
 			}
 
 			void add_ref() noexcept
@@ -200,19 +443,32 @@ namespace corsl
 
 			void release() noexcept
 			{
-				if (1 == this->use_count.fetch_sub(1, std::memory_order_relaxed))
+				if (1 == this->use_count.fetch_sub(1, std::memory_order_acq_rel))
 					destroy();
 			}
 
+			// Creates a shared state for promise<T> in a single allocation, the caller owns one reference
+			static promise_type_ *create_standalone()
+			{
+				auto result = new promise_type_;
+				result->delete_standalone = [](promise_type_ *p) noexcept { delete p; };
+				result->add_ref();
+				return result;
+			}
+
+			// Coroutine frame is destroyed by whoever comes last: either the future or the final awaiter
 			void destroy() noexcept
 			{
-				std::unique_lock l{ this->lock };
-				future_exists = false;
-				if (destroy_resume)
+				if (delete_standalone)
 				{
-					l.unlock();
-					destroy_resume.destroy();
+					delete_standalone(this);
+					return;
 				}
+
+				const auto state = this->state.exchange(state_detached, std::memory_order_acq_rel);
+				assert(state <= state_detached && "future cannot be destroyed while being awaited");
+				if (state == state_ready && destroy_resume)
+					destroy_resume.destroy();
 			}
 
 			template<class V>
@@ -224,6 +480,14 @@ namespace corsl
 					return std::forward<V>(expr);
 			}
 
+			// Coroutines returning std::expected report cancellation as an error value instead of throwing
+			template<class V>
+			auto await_transform(V &&expr) requires is_expected_v<T>
+			{
+				using awaiter_type = decltype(get_awaiter(std::forward<V>(expr)));
+				return expected_cancellation_awaiter<awaiter_type, promise_type_>{ get_awaiter(std::forward<V>(expr)), this->is_cancelled() };
+			}
+
 			corsl::details::cancellation_token_transport await_transform(corsl::details::cancellation_source &source) noexcept
 			{
 				return { source, std::coroutine_handle<promise_base0>::from_promise(*this) };
@@ -235,148 +499,269 @@ namespace corsl
 			}
 		};
 
+		// Calls a continuation with the result of a completed future. Continuation may accept the result (nothing
+		// for future<void>), the future itself or no arguments
+		template<class F, class T>
+		decltype(auto) invoke_continuation(F &continuation, future<T> &&source)
+		{
+			if constexpr (std::same_as<void, T>)
+			{
+				if constexpr (std::invocable<F &>)
+				{
+					source.await_resume();
+					return continuation();
+				}
+				else
+					return continuation(std::move(source));
+			}
+			else if constexpr (std::invocable<F &, T>)
+				return continuation(source.await_resume());
+			else if constexpr (std::invocable<F &, future<T>>)
+				return continuation(std::move(source));
+			else
+			{
+				source.await_resume();
+				return continuation();
+			}
+		}
+
+		template<class F, class T>
+		using continuation_result_t = std::remove_cvref_t<decltype(invoke_continuation(std::declval<F &>(), std::declval<future<T>>()))>;
+
+		template<class R>
+		concept awaitable_result = requires(R &r)
+		{
+			r.await_ready();
+			r.await_resume();
+		};
+
+		// Result type of a continuation stage: awaitable results are awaited
+		template<class R>
+		struct stage_result
+		{
+			using type = R;
+		};
+
+		template<awaitable_result R>
+		struct stage_result<R>
+		{
+			using type = std::remove_cvref_t<decltype(std::declval<R &>().await_resume())>;
+		};
+
+		template<class R>
+		using stage_result_t = typename stage_result<R>::type;
+
+		// Fused continuation stage: shared state of the resulting future which is installed into the source future
+		// as its completion node. Continuation runs where the source resumes its awaiter: on the executor passed to
+		// set, set_on or set_async, or inline for set_inline and coroutines that return a value
+		template<class R, class T, class F>
+		struct then_state : promise_type_<R>, completion_node
+		{
+			future<T> source;
+			F continuation;
+
+			then_state(future<T> &&source, F &&continuation) :
+				completion_node{ &complete },
+				source{ std::move(source) },
+				continuation{ std::move(continuation) }
+			{
+				this->delete_standalone = [](promise_type_<R> *p) noexcept { delete static_cast<then_state *>(p); };
+				this->add_ref();	// owned by the resulting future
+				this->add_ref();	// released when the source completes
+			}
+
+			static void complete(completion_node *node) noexcept
+			{
+				const auto self = static_cast<then_state *>(node);
+				try
+				{
+					if constexpr (std::same_as<void, R>)
+					{
+						invoke_continuation(self->continuation, std::move(self->source));
+						self->value = empty_type{};
+					}
+					else
+						self->value = invoke_continuation(self->continuation, std::move(self->source));
+				}
+				catch (...)
+				{
+					self->value = std::current_exception();
+				}
+				self->source = {};
+				self->complete_on(inline_executor{});
+				self->release();
+			}
+		};
+
 		template<class T>
 		class  __declspec(empty_bases) future : public future_base<T>
 		{
 			friend struct promise_type_<T>;
+			template<class>
+			friend class future;
+			template<class, class>
+			friend class shared_future_impl;
 			static_assert(!std::is_reference_v<T>, "future<T> is not allowed for reference types");
 
 			using promise_type_ = promise_type_<T>;
-			using coro_type = std::coroutine_handle<promise_type_>;
-			coro_type coro;
+			promise_type_ *promise_;
 
-			future(coro_type coro) noexcept :
-				coro{ coro }
+			future(promise_type_ *promise_) noexcept :
+				promise_{ promise_ }
 			{}
 
-			struct special_await
+			// Awaits completion without retrieving the result
+			struct completion_awaiter
 			{
-				coro_type coro;
+				promise_type_ *promise_;
 
 				bool await_ready() const noexcept
 				{
-					std::unique_lock<mutex> l{ coro.promise().lock };
-					auto ready = coro.promise().is_ready(l);
-					if (!ready)
-						l.release();
-					return ready;
+					return promise_->is_ready();
 				}
 
 				bool await_suspend(std::coroutine_handle<> resume) noexcept
 				{
-					std::unique_lock<mutex> l{ coro.promise().lock, std::adopt_lock };
-					return coro.promise().start_async(resume, std::move(l));
+					return promise_->set_continuation(resume);
 				}
 
-				void await_resume() noexcept
+				static void await_resume() noexcept
 				{
 				}
 			};
 
+			// Continuation stage that needs a coroutine: it either resumes on an executor or awaits the continuation's result
+			template<class R, class F, class E>
+			static future<R> then_stage(future source, F continuation, E e)
+			{
+				co_await completion_awaiter{ source.promise_ };
+				if constexpr (!std::same_as<E, inline_executor>)
+					co_await resume_background(e);
+				if constexpr (awaitable_result<continuation_result_t<F, T>>)
+					co_return co_await invoke_continuation(continuation, std::move(source));
+				else
+					co_return invoke_continuation(continuation, std::move(source));
+			}
+
 		public:
 			using promise_type = promise_type_;
 			using result_type = T;
 
 			future() noexcept :
-				coro{ nullptr }
+				promise_{ nullptr }
 			{}
 
 			~future()
 			{
-				if (coro)
-					coro.promise().release();
+				if (promise_)
+					promise_->release();
 			}
 
 			explicit operator bool()const noexcept
 			{
-				return !!coro;
+				return !!promise_;
 			}
 
 			future(const future &o) = delete;
 			future &operator =(const future &o) = delete;
 
 			future(future &&o) noexcept :
-				coro{ o.coro }
+				promise_{ o.promise_ }
 			{
-				o.coro = nullptr;
+				o.promise_ = nullptr;
 			}
 
 			future &operator =(future &&o) noexcept
 			{
 				using std::swap;
-				swap(coro, o.coro);
+				swap(promise_, o.promise_);
 				return *this;
 			}
 
 			void wait() const noexcept
 			{
-				assert(coro && "Calling get() or wait() on uninitialized future is prohibited");
-				{
-					std::unique_lock l{ coro.promise().lock };
-					if (coro.promise().is_ready(l))
-						return;
-				}
+				assert(promise_ && "Calling get() or wait() on uninitialized future is prohibited");
+				promise_->wait();
+			}
 
-				srwlock x;
-				condition_variable cv;
-				bool completed = false;
+			// Timed waits return false if the future has not completed in time. The future may be waited for or awaited again after that
+			template<class Clock, class Duration>
+			bool wait_until(const std::chrono::time_point<Clock, Duration> &deadline) const noexcept
+			{
+				assert(promise_ && "Calling wait_until() on uninitialized future is prohibited");
+				return promise_->wait_until(deadline);
+			}
 
-				[&]() noexcept -> fire_and_forget<>
+			// A timeout that does not fit into the clock's range waits without a deadline
+			template<class Rep, class Period>
+			bool wait_for(const std::chrono::duration<Rep, Period> &timeout) const noexcept
+			{
+				using clock = std::chrono::steady_clock;
+				const auto now = clock::now();
+				if (timeout <= timeout.zero())
+					return wait_until(now);
+				if (timeout >= std::chrono::duration_cast<std::chrono::duration<Rep, Period>>(clock::time_point::max() - now))
 				{
-					co_await special_await{ coro };
-					const std::lock_guard guard{ x };
-					completed = true;
-					cv.wake_one();
-				}();
-
-				const std::lock_guard guard{ x };
-				cv.wait_while(x, [&] { return !completed; });
+					wait();
+					return true;
+				}
+				return wait_until(now + timeout);
 			}
 
 			decltype(auto) get() const &
 			{
 				wait();
-				return this->iget(coro.promise().get());
+				return this->iget(promise_->get());
 			}
 
 			decltype(auto) get() &&
 			{
 				wait();
-				return std::move(*this).iget(coro.promise().get());
+				return std::move(*this).iget(promise_->get());
 			}
 
 			bool is_ready() const noexcept
 			{
-				assert(coro && "Calling is_ready for uninitialized future is invalid");
-				std::unique_lock<mutex> l{ coro.promise().lock };
-				return coro.promise().is_ready(l);
+				assert(promise_ && "Calling is_ready for uninitialized future is invalid");
+				return promise_->is_ready();
+			}
+
+			// Runs the node in the thread that completes the future, instead of resuming an awaiting coroutine.
+			// Returns false if the future has already completed, the node is not run in this case
+			bool set_node(completion_node &node) noexcept
+			{
+				assert(promise_ && "Calling set_node for uninitialized future is invalid");
+				return promise_->set_node(node);
+			}
+
+			// Requests cancellation of the coroutine: its next co_await throws operation_cancelled (or produces
+			// cancellation error for std::expected results). Has no effect on completed future
+			void cancel() const noexcept
+			{
+				assert(promise_ && "Calling cancel for uninitialized future is invalid");
+				promise_->cancel();
 			}
 
 			// await
 			bool await_ready() const noexcept
 			{
-				assert(coro && "co_await with uninitialized future is invalid");
-				std::unique_lock<mutex> l{ coro.promise().lock };
-				auto ready = coro.promise().is_ready(l);
-				if (!ready)
-					l.release();
-				return ready;
+				assert(promise_ && "co_await with uninitialized future is invalid");
+				return promise_->is_ready();
 			}
 
 			bool await_suspend(std::coroutine_handle<> resume) noexcept
 			{
-				std::unique_lock<mutex> l{ coro.promise().lock, std::adopt_lock };
-				return coro.promise().start_async(resume, std::move(l));
+				return promise_->set_continuation(resume);
 			}
 
 			void iawait_resume(std::true_type)
 			{
-				coro.promise().get();
+				promise_->get();
 			}
 
 			decltype(auto) iawait_resume(std::false_type)
 			{
-				return std::move(coro.promise().get());
+				return std::move(promise_->get());
 			}
 
 			decltype(auto) await_resume()
@@ -384,43 +769,37 @@ namespace corsl
 				return iawait_resume(std::is_same<T, void>{});
 			}
 
+			// Continuation that returns an awaitable is an asynchronous stage: its result is awaited in a coroutine.
+			// Other continuations are fused into the chain: they run where an awaiting coroutine would be resumed
+			// and do not allocate coroutine frames
 			template<class F>
-			auto then(F continuation) && -> std::invoke_result_t<F, result_type>
-			{
-				co_return co_await continuation(co_await std::move(*this));
-			}
-
-			template<class F>
-			auto then(F continuation) && -> std::invoke_result_t<F, future<result_type>>
+			auto then(F continuation) && -> future<stage_result_t<continuation_result_t<F, T>>>
 			{
-				co_return co_await continuation(std::move(*this));
+				assert(promise_ && "then() with uninitialized future is invalid");
+				using R = continuation_result_t<F, T>;
+				if constexpr (awaitable_result<R>)
+					return then_stage<stage_result_t<R>>(std::move(*this), std::move(continuation), inline_executor{});
+				else
+				{
+					const auto state = new then_state<R, T, F>{ std::move(*this), std::move(continuation) };
+					if (!state->source.promise_->set_node(*state))
+						state->on_complete(state);
+					return { state };
+				}
 			}
 
-			template<class F>
-			auto then(F continuation) && -> std::invoke_result_t<F>
+			// Continuation runs on a given executor
+			template<executor E, class F>
+			auto then_on(const E &e, F continuation) && -> future<stage_result_t<continuation_result_t<F, T>>>
 			{
-				co_await *this;
-				co_await continuation();
+				assert(promise_ && "then_on() with uninitialized future is invalid");
+				if constexpr (std::same_as<E, inline_executor>)
+					return std::move(*this).then(std::move(continuation));
+				else
+					return then_stage<stage_result_t<continuation_result_t<F, T>>>(std::move(*this), std::move(continuation), e);
 			}
 		};
 
-		inline future<> promise_base<void>::return_void_async() noexcept
-		{
-			std::unique_lock<mutex> l{ lock };
-			value = empty_type{};
-			co_await resume_background();
-			check_resume(std::move(l));
-		}
-
-		template<class T>
-		inline future<> promise_base<T>::return_value_async(T v) noexcept
-		{
-			std::unique_lock l{ this->lock };
-			this->value = std::move(v);
-			co_await resume_background();
-			this->check_resume(std::move(l));
-		}
-
 		template<class F>
 		struct is_future : std::false_type
 		{};
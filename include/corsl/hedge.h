@@ -0,0 +1,314 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "when_any.h"
+#include "async_timer.h"
+#include "future.h"
+#include "cancel.h"
+
+#include <shared_mutex>
+
+namespace corsl
+{
+	namespace details
+	{
+		///////////////////////////////////
+		// hedge
+
+		// Tracks latencies of recent successful attempts and suggests the hedging delay as their percentile.
+		// The object is shared by hedge calls and must outlive them
+		class hedge_policy
+		{
+			mutable srwlock lock;
+			std::vector<winrt::Windows::Foundation::TimeSpan> samples;	// ring buffer of the last window samples
+			size_t next{};
+			const size_t window;
+			const double percentile;
+			const winrt::Windows::Foundation::TimeSpan initial_delay;
+
+			// The percentile is not meaningful until there is at least one sample above it
+			size_t min_samples() const noexcept
+			{
+				if (percentile >= 1)
+					return window;
+				return std::min(window, static_cast<size_t>(std::ceil(1 / (1 - percentile))));
+			}
+
+		public:
+			explicit hedge_policy(winrt::Windows::Foundation::TimeSpan initial_delay, size_t window = 128, double percentile = 0.95) :
+				window{ std::max<size_t>(window, 1) },
+				percentile{ std::clamp(percentile, 0.0, 1.0) },
+				initial_delay{ initial_delay }
+			{
+				samples.reserve(this->window);
+			}
+
+			hedge_policy(const hedge_policy &) = delete;
+			hedge_policy &operator =(const hedge_policy &) = delete;
+
+			// Initial delay is returned until enough samples are recorded
+			winrt::Windows::Foundation::TimeSpan delay() const
+			{
+				std::vector<winrt::Windows::Foundation::TimeSpan> sorted;
+				{
+					std::shared_lock l{ lock };
+					if (samples.size() < min_samples())
+						return initial_delay;
+					sorted = samples;
+				}
+				const auto rank = std::max<size_t>(static_cast<size_t>(std::ceil(percentile * sorted.size())), 1) - 1;
+				std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+				return sorted[rank];
+			}
+
+			void record(winrt::Windows::Foundation::TimeSpan latency) noexcept
+			{
+				std::scoped_lock l{ lock };
+				if (samples.size() < window)
+					samples.push_back(latency);
+				else
+				{
+					samples[next] = latency;
+					next = (next + 1) % window;
+				}
+			}
+		};
+
+		template<class Factory>
+		inline constexpr bool factory_takes_source = std::invocable<Factory &, const cancellation_source &>;
+
+		template<class Factory>
+		using hedge_task_t = std::decay_t<typename std::conditional_t<factory_takes_source<Factory>, std::invoke_result<Factory &, const cancellation_source &>, std::invoke_result<Factory &>>::type>;
+
+		template<class State, class Awaitable>
+		inline fire_and_forget<> hedge_helper_single(std::shared_ptr<State> state, Awaitable task, size_t index) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<result_type<void>, get_result_type_t<Awaitable>>)
+				{
+					co_await task;
+					state->finished(index);
+				}
+				else
+				{
+					state->finished(co_await task, index);
+				}
+			}
+			catch (...)
+			{
+				State::attempt_failed(state, index);
+			}
+		}
+
+		// Block shared by the hedging coroutine, both attempts and the backup timer. An attempt is started under
+		// the lock and only while the race is open, so the awaiting coroutine can reliably cancel all of them.
+		// The first attempt to succeed wins. A failed attempt only finishes the race if the other one has failed too
+		template<class Result, class Factory>
+		struct hedge_state : when_any_block<Result>
+		{
+			using task_t = hedge_task_t<Factory>;
+
+			Factory factory;
+			srwlock lock;
+			bool closed{ false };
+			std::array<bool, 2> launched{};	// each attempt is started at most once, even if the factory throws
+			std::array<std::optional<task_t>, 2> attempts;
+			std::array<std::optional<cancellation_source>, 2> sources;	// per attempt, if the factory accepts one
+			std::array<std::chrono::steady_clock::time_point, 2> started_at;
+			std::array<shared_child_node, 2> nodes;
+			std::atomic<int> failures{};
+			async_timer<> timer;
+
+			hedge_state(Factory &&factory) :
+				factory{ std::move(factory) }
+			{
+				this->cancel_losers = &stop_timer;
+			}
+
+			static void stop_timer(when_any_block<Result> *block) noexcept
+			{
+				static_cast<hedge_state *>(block)->timer.cancel();
+			}
+
+			// If the primary attempt fails, the backup is started without waiting for the delay
+			static void attempt_failed(const std::shared_ptr<hedge_state> &state, size_t index) noexcept
+			{
+				if (state->failures.fetch_add(1, std::memory_order_acq_rel) == 1)
+					state->finished_exception();
+				else if (index == 0)
+				{
+					state->timer.cancel();
+					launch(state, 1);
+				}
+			}
+
+			static void deliver(const std::shared_ptr<hedge_state> &state, task_t &task, size_t index) noexcept
+			{
+				try
+				{
+					if constexpr (std::same_as<result_type<void>, get_result_type_t<task_t>>)
+					{
+						get_ready_result(task);
+						state->finished(index);
+					}
+					else
+					{
+						state->finished(get_ready_result(task), index);
+					}
+				}
+				catch (...)
+				{
+					attempt_failed(state, index);
+				}
+			}
+
+			static void start(const std::shared_ptr<hedge_state> &state, size_t index)
+			{
+				{
+					std::scoped_lock l{ state->lock };
+					if (state->closed || std::exchange(state->launched[index], true))
+						return;
+					if constexpr (factory_takes_source<Factory>)
+						state->attempts[index].emplace(std::invoke(state->factory, state->sources[index].emplace()));
+					else
+						state->attempts[index].emplace(std::invoke(state->factory));
+					state->started_at[index] = std::chrono::steady_clock::now();
+				}
+
+				auto &task = *state->attempts[index];
+				if constexpr (node_awaitable<task_t>)
+				{
+					auto &node = state->nodes[index];
+					node.on_complete = [](completion_node *node) noexcept
+					{
+						const auto child = static_cast<shared_child_node *>(node);
+						const auto state = std::static_pointer_cast<hedge_state>(std::move(child->master));
+						deliver(state, *state->attempts[child->index], child->index);
+					};
+					if (!when_any_set_node(task, node, state, index))
+						node.on_complete(&node);
+				}
+				else
+					hedge_helper_single(state, std::move(task), index);
+			}
+
+			// A throwing factory counts as a failed attempt
+			static void launch(const std::shared_ptr<hedge_state> &state, size_t index) noexcept
+			{
+				try
+				{
+					start(state, index);
+				}
+				catch (...)
+				{
+					attempt_failed(state, index);
+				}
+			}
+
+			void cancel_attempts() noexcept
+			{
+				std::scoped_lock l{ lock };
+				closed = true;
+				for (size_t i = 0; i < attempts.size(); ++i)
+				{
+					if (sources[i])
+						sources[i]->cancel();
+					if (attempts[i])
+						cancel_child(*attempts[i]);
+				}
+			}
+		};
+
+		template<class State>
+		inline fire_and_forget<> hedge_backup(std::shared_ptr<State> state, winrt::Windows::Foundation::TimeSpan delay) noexcept
+		{
+			// the timer is cancelled as soon as the first attempt completes
+			const auto expired = co_await state->timer.wait(delay, std::nothrow);
+			if (expired)
+				State::launch(state, 1);
+		}
+
+		template<class State>
+		struct hedge_awaitable
+		{
+			const std::shared_ptr<State> &ptr;
+			winrt::Windows::Foundation::TimeSpan delay;
+
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				// the awaiting coroutine may be resumed and destroy the state pointer before both attempts are started
+				const auto state = ptr;
+				state->resume.store(handle, std::memory_order_relaxed);
+				if (delay.count() > 0)
+				{
+					// the backup timer is armed first, so it is cancelled even if the first attempt completes right away
+					hedge_backup(state, delay);
+					State::launch(state, 0);
+				}
+				else
+				{
+					State::launch(state, 0);
+					State::launch(state, 1);
+				}
+			}
+
+			static void await_resume() noexcept
+			{
+			}
+		};
+
+		template<class Factory>
+		using hedge_value_t = std::decay_t<invoke_result<get_result_type_t<hedge_task_t<Factory>>>>;
+
+		template<class Factory, class T = hedge_value_t<Factory>>
+		inline future<T> hedge_impl(Factory factory, winrt::Windows::Foundation::TimeSpan delay, hedge_policy *policy)
+		{
+			using state_t = hedge_state<std::conditional_t<std::is_void_v<T>, no_result, T>, Factory>;
+			const auto state = std::make_shared<state_t>(std::move(factory));
+
+			co_await hedge_awaitable<state_t>{ state, delay };
+			state->cancel_attempts();
+
+			if (state->exception)
+				std::rethrow_exception(state->exception);
+			if (policy)
+				policy->record(std::chrono::duration_cast<winrt::Windows::Foundation::TimeSpan>(std::chrono::steady_clock::now() - state->started_at[state->index]));
+			if constexpr (!std::is_void_v<T>)
+				co_return std::move(state->result);
+		}
+
+		// Starts an attempt by calling factory() or factory(const cancellation_source &) and starts a backup attempt if
+		// the first one has not succeeded within the delay or as soon as it fails. The first attempt to succeed wins,
+		// the other one is cancelled: futures directly and any attempt through its cancellation source. The exception
+		// of the last attempt to fail is rethrown if both fail
+		template<class Factory>
+		inline auto hedge(Factory factory, winrt::Windows::Foundation::TimeSpan delay)
+		{
+			return hedge_impl(std::move(factory), delay, nullptr);
+		}
+
+		// The delay is the policy's latency percentile, the latency of the winning attempt is recorded to the policy
+		// (failures are not recorded)
+		template<class Factory>
+		inline auto hedge(Factory factory, hedge_policy &policy)
+		{
+			return hedge_impl(std::move(factory), policy.delay(), &policy);
+		}
+	}
+
+	using details::hedge_policy;
+	using details::hedge;
+}
@@ -8,22 +8,32 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <type_traits>
 #include <tuple>
 #include <utility>
 #include <exception>
+#include <expected>
+#include <system_error>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <array>
 #include <mutex>
 #include <string>
 #include <string_view>
 #include <functional>
 #include <cassert>
+#include <cmath>
 #include <coroutine>
 #include <variant>
 #include <concepts>
 #include <ranges>
 #include <semaphore>
+#include <span>
+#include <thread>
+#include <vector>
 
 #include <winrt/base.h>
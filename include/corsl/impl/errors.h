@@ -406,6 +406,38 @@ namespace corsl
 		class timer_cancelled : public operation_cancelled
 		{
 		};
+
+		// Error value that non-throwing awaitables and coroutines returning future<std::expected<T, E>> report instead
+		// of throwing operation_cancelled. May be specialized for other error types
+		template<class E>
+		struct cancellation_error;
+
+		template<>
+		struct cancellation_error<HRESULT>
+		{
+			static HRESULT get() noexcept
+			{
+				return HRESULT_FROM_WIN32(ERROR_CANCELLED);
+			}
+		};
+
+		template<>
+		struct cancellation_error<winrt::hresult>
+		{
+			static winrt::hresult get() noexcept
+			{
+				return HRESULT_FROM_WIN32(ERROR_CANCELLED);
+			}
+		};
+
+		template<>
+		struct cancellation_error<std::error_code>
+		{
+			static std::error_code get() noexcept
+			{
+				return std::make_error_code(std::errc::operation_canceled);
+			}
+		};
 	}
 
 	using details::error_class;
@@ -420,6 +452,7 @@ namespace corsl
 
 	using details::operation_cancelled;
 	using details::timer_cancelled;
+	using details::cancellation_error;
 
 	using details::throw_error;
 	using details::throw_win32_error;
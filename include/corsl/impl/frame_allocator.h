@@ -0,0 +1,278 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "dependencies.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		// Recycling allocator for coroutine frames
+		// Each thread keeps free lists of frames grouped in size classes. A frame freed on the thread that allocated it
+		// goes back to that thread's free list. A frame freed on another thread is pushed to the owner's lock-free
+		// "remote" list, which the owner takes in one operation when its local list runs out.
+		// A cache is never freed: when a thread exits, its cache is adopted by the next new thread, so frames that are
+		// still alive may always be returned to their owner.
+		class frame_allocator
+		{
+			static constexpr size_t granularity = 64;
+			static constexpr size_t class_count = 16;	// frames up to 1KB are cached, larger frames go to global operator new
+			static constexpr unsigned max_cached = 256;	// per size class
+
+			struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) header
+			{
+				frame_allocator *owner;	// nullptr for uncached frames
+				size_t size_class;
+			};
+
+			struct block
+			{
+				block *next;
+			};
+
+			block *free_lists[class_count]{};
+			unsigned counts[class_count]{};
+			std::atomic<block *> remote_lists[class_count]{};
+			frame_allocator *next_orphan{};
+
+			inline static thread_local frame_allocator *this_thread{};
+			inline static std::mutex orphans_lock;
+			inline static frame_allocator *orphans{};
+
+			struct holder
+			{
+				frame_allocator *cache;
+
+				holder() :
+					cache{ adopt() }
+				{
+					this_thread = cache;
+				}
+
+				~holder()
+				{
+					this_thread = nullptr;
+					std::scoped_lock l{ orphans_lock };
+					cache->next_orphan = std::exchange(orphans, cache);
+				}
+			};
+
+			static frame_allocator *adopt()
+			{
+				{
+					std::scoped_lock l{ orphans_lock };
+					if (orphans)
+						return std::exchange(orphans, orphans->next_orphan);
+				}
+				return new frame_allocator{};
+			}
+
+			static frame_allocator &current()
+			{
+				thread_local holder h;
+				return *h.cache;
+			}
+
+			block *pop(size_t size_class) noexcept
+			{
+				if (!free_lists[size_class]) [[unlikely]]
+				{
+					// take everything other threads have returned so far, blocks above the cache limit are freed
+					auto list = remote_lists[size_class].exchange(nullptr, std::memory_order_acquire);
+					unsigned count = 0;
+					free_lists[size_class] = list;
+					for (auto b = list; b; b = b->next)
+					{
+						if (++count == max_cached)
+						{
+							for (auto excess = std::exchange(b->next, nullptr); excess;)
+								::operator delete(std::exchange(excess, excess->next));
+							break;
+						}
+					}
+					counts[size_class] = count;
+				}
+
+				auto result = free_lists[size_class];
+				if (result)
+				{
+					free_lists[size_class] = result->next;
+					--counts[size_class];
+				}
+				return result;
+			}
+
+			void push(block *b, size_t size_class) noexcept
+			{
+				if (counts[size_class] >= max_cached)
+					::operator delete(b);
+				else
+				{
+					b->next = free_lists[size_class];
+					free_lists[size_class] = b;
+					++counts[size_class];
+				}
+			}
+
+			void push_remote(block *b, size_t size_class) noexcept
+			{
+				auto &list = remote_lists[size_class];
+				b->next = list.load(std::memory_order_relaxed);
+				while (!list.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed))
+					;
+			}
+
+		public:
+			static void *allocate(size_t size)
+			{
+				const auto size_class = (size + sizeof(header) - 1) / granularity;
+				if (size_class >= class_count) [[unlikely]]
+					return new (::operator new(size + sizeof(header))) header{ nullptr, class_count } + 1;
+
+				auto &cache = current();
+				void *memory = cache.pop(size_class);
+				if (!memory)
+					memory = ::operator new((size_class + 1) * granularity);
+				return new (memory) header{ &cache, size_class } + 1;
+			}
+
+			static void deallocate(void *pointer) noexcept
+			{
+				const auto h = static_cast<header *>(pointer) - 1;
+				const auto owner = h->owner;
+				const auto size_class = h->size_class;
+				const auto b = reinterpret_cast<block *>(h);
+
+				if (!owner)
+					::operator delete(b);
+				else if (owner == this_thread)
+					owner->push(b, size_class);
+				else
+					owner->push_remote(b, size_class);
+			}
+		};
+
+		// Every frame allocated by frame_allocation_base has a trailer that starts with a pointer to deallocation function
+		using frame_deallocate_fn = void (*)(void *frame, size_t size) noexcept;
+
+		constexpr size_t get_frame_trailer_offset(size_t size) noexcept
+		{
+			return (size + alignof(frame_deallocate_fn) - 1) & ~(alignof(frame_deallocate_fn) - 1);
+		}
+
+		// Unit of allocation for caller-supplied allocators
+		struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) frame_block
+		{
+			char data[__STDCPP_DEFAULT_NEW_ALIGNMENT__];
+		};
+
+		template<class Alloc>
+		struct frame_allocator_trailer
+		{
+			frame_deallocate_fn deallocate;
+			Alloc alloc;
+		};
+
+		template<class A>
+		concept frame_allocator_type = requires(A &a)
+		{
+			typename A::value_type;
+			a.allocate(size_t{});
+		};
+
+		// Base class for promise types
+		// A coroutine that has std::allocator_arg_t followed by an allocator or std::pmr::memory_resource * as its leading
+		// parameters (after the implicit object parameter for member functions and lambdas) gets its frame allocated from
+		// that allocator. Other frames come from global operator new, or from frame_allocator if CORSL_USE_FRAME_ALLOCATOR
+		// is defined
+		struct __declspec(empty_bases) frame_allocation_base
+		{
+		private:
+			template<class BlockAlloc>
+			static size_t get_block_count(size_t size) noexcept
+			{
+				const auto total = get_frame_trailer_offset(size) + sizeof(frame_allocator_trailer<BlockAlloc>);
+				return (total + sizeof(frame_block) - 1) / sizeof(frame_block);
+			}
+
+			static frame_deallocate_fn &get_deallocate(void *frame, size_t size) noexcept
+			{
+				return *std::launder(reinterpret_cast<frame_deallocate_fn *>(static_cast<char *>(frame) + get_frame_trailer_offset(size)));
+			}
+
+			template<class BlockAlloc>
+			static void deallocate_with(void *frame, size_t size) noexcept
+			{
+				using trailer = frame_allocator_trailer<BlockAlloc>;
+				auto t = std::launder(reinterpret_cast<trailer *>(static_cast<char *>(frame) + get_frame_trailer_offset(size)));
+				BlockAlloc alloc{ std::move(t->alloc) };
+				t->~trailer();
+				std::allocator_traits<BlockAlloc>::deallocate(alloc, static_cast<frame_block *>(frame), get_block_count<BlockAlloc>(size));
+			}
+
+			template<class Alloc>
+			static void *allocate_with(size_t size, const Alloc &alloc_)
+			{
+				using block_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<frame_block>;
+				using trailer = frame_allocator_trailer<block_alloc>;
+				static_assert(std::is_pointer_v<typename std::allocator_traits<block_alloc>::pointer>, "Allocators with fancy pointers are not supported");
+				static_assert(alignof(trailer) == alignof(frame_deallocate_fn), "Allocator alignment is too big");
+
+				block_alloc alloc{ alloc_ };
+				void *frame = std::allocator_traits<block_alloc>::allocate(alloc, get_block_count<block_alloc>(size));
+				new (static_cast<char *>(frame) + get_frame_trailer_offset(size)) trailer{ &deallocate_with<block_alloc>, std::move(alloc) };
+				return frame;
+			}
+
+		public:
+			static void *operator new(size_t size)
+			{
+				const auto total = get_frame_trailer_offset(size) + sizeof(frame_deallocate_fn);
+#if defined(CORSL_USE_FRAME_ALLOCATOR)
+				auto frame = frame_allocator::allocate(total);
+				get_deallocate(frame, size) = [](void *frame, size_t) noexcept { frame_allocator::deallocate(frame); };
+#else
+				auto frame = ::operator new(total);
+				get_deallocate(frame, size) = [](void *frame, size_t) noexcept { ::operator delete(frame); };
+#endif
+				return frame;
+			}
+
+			template<frame_allocator_type Alloc, class... Args>
+			static void *operator new(size_t size, std::allocator_arg_t, const Alloc &alloc, const Args &...)
+			{
+				return allocate_with(size, alloc);
+			}
+
+			template<class This, frame_allocator_type Alloc, class... Args>
+			static void *operator new(size_t size, const This &, std::allocator_arg_t, const Alloc &alloc, const Args &...)
+			{
+				return allocate_with(size, alloc);
+			}
+
+			template<class... Args>
+			static void *operator new(size_t size, std::allocator_arg_t, std::pmr::memory_resource *resource, const Args &...)
+			{
+				return allocate_with(size, std::pmr::polymorphic_allocator<>{ resource });
+			}
+
+			template<class This, class... Args>
+			static void *operator new(size_t size, const This &, std::allocator_arg_t, std::pmr::memory_resource *resource, const Args &...)
+			{
+				return allocate_with(size, std::pmr::polymorphic_allocator<>{ resource });
+			}
+
+			static void operator delete(void *frame, size_t size) noexcept
+			{
+				get_deallocate(frame, size)(frame, size);
+			}
+		};
+	}
+}
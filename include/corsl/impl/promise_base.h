@@ -30,6 +30,15 @@ namespace corsl
 			}
 		};
 
+		// Callback invoked instead of resuming a coroutine. It runs where an awaiting coroutine would be resumed:
+		// on the executor the value is published on, or in the publishing thread
+		struct completion_node
+		{
+			void (*on_complete)(completion_node *node) noexcept;
+			completion_node *next{};	// link in a list of nodes waiting for the same value
+			bool run_inline{};	// the node only wakes a blocked thread and always runs in the publishing thread
+		};
+
 		class cancellation_source;
 		struct cancellation_token_transport
 		{
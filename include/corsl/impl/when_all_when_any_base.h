@@ -9,6 +9,7 @@
 #pragma once
 
 #include "dependencies.h"
+#include "promise_base.h"
 
 #include <winrt/Windows.Foundation.h>
 #include <boost/mp11/list.hpp>
@@ -26,7 +27,7 @@ namespace corsl
 		template<class T>
 		class future;
 
-		template<class T>
+		template<class T, class Scheduler>
 		class shared_future;
 
 		// no_result will substitute 'void' in tuple
@@ -62,6 +63,12 @@ namespace corsl
 			await_resume(cv);
 		};
 
+		template<class T>
+		concept has_member_co_await = !has_await_resume<T> && requires(T &v)
+		{
+			v.operator co_await();
+		};
+
 		template<class Awaitable>
 		struct get_result_type;
 
@@ -83,6 +90,67 @@ namespace corsl
 		{
 			using type = result_type<std::decay_t<decltype(await_resume(std::declval<T &>()))>>;
 		};
+
+		template<has_member_co_await T>
+		struct get_result_type<T>
+		{
+			using type = result_type<std::decay_t<decltype(std::declval<T &>().operator co_await().await_resume())>>;
+		};
+
+		// Library awaitables (future and shared_future) can run a completion node when they complete. Combinators
+		// install their nodes directly instead of starting a helper coroutine for every child. A node runs where the
+		// child would resume an awaiting coroutine, so the combinator resumes its awaiter on the child's executor
+		template<class T>
+		concept node_awaitable = requires(T &v, completion_node &node)
+		{
+			{ v.set_node(node) } -> std::same_as<bool>;
+		};
+
+		// Result of a completed node_awaitable
+		template<node_awaitable T>
+		inline decltype(auto) get_ready_result(T &v)
+		{
+			if constexpr (has_await_resume<T>)
+				return v.await_resume();
+			else
+				return v.get();
+		}
+
+		// Completion node of a combinator's child
+		struct child_node : completion_node
+		{
+			void *master;
+			size_t index;
+		};
+
+		// Completion node that keeps combinator's shared state alive until the child completes
+		struct shared_child_node : completion_node
+		{
+			std::shared_ptr<void> master;
+			size_t index;
+		};
+
+		// Children that stay in combinator's shared state (futures) are cancelled directly. Others may only observe
+		// a linked cancellation_source
+		template<class Awaitable>
+		inline void cancel_child(Awaitable &task) noexcept
+		{
+			if constexpr (node_awaitable<Awaitable> && requires { task.cancel(); })
+				task.cancel();
+		}
+
+		// Tasks is either a tuple or a range of children
+		template<class Tasks>
+		inline void cancel_children(Tasks &tasks) noexcept
+		{
+			if constexpr (sr::range<Tasks>)
+			{
+				for (auto &task : tasks)
+					cancel_child(task);
+			}
+			else
+				std::apply([](auto &...tasks) noexcept { (..., cancel_child(tasks)); }, tasks);
+		}
 	}
 
 	using details::no_result;
@@ -18,7 +18,7 @@ namespace corsl
 		class promise
 		{
 			using promise_type = promise_type_<T>;
-			std::shared_ptr<promise_type> promise_{ std::make_shared<promise_type>() };
+			promise_type *promise_{ promise_type::create_standalone() };
 
 			// sync set is no longer supported
 			// 
@@ -45,9 +45,44 @@ namespace corsl
 			{
 				promise_->return_void_async();
 			}
+
+			template<class A, class E, class V>
+			void iset_on(const E &e, V &&v) noexcept requires (!std::same_as<void, A>)
+			{
+				promise_->return_value_on(e, std::forward<V>(v));
+			}
+
+			template<class A, class E>
+			void iset_on(const E &e) noexcept requires std::same_as<void, A>
+			{
+				promise_->return_void_on(e);
+			}
 		public:
 			promise() = default;
 
+			promise(const promise &o) noexcept :
+				promise_{ o.promise_ }
+			{
+				promise_->add_ref();
+			}
+
+			promise(promise &&o) noexcept :
+				promise_{ std::exchange(o.promise_, nullptr) }
+			{
+			}
+
+			promise &operator =(promise o) noexcept
+			{
+				std::swap(promise_, o.promise_);
+				return *this;
+			}
+
+			~promise()
+			{
+				if (promise_)
+					promise_->release();
+			}
+
 			void set() noexcept
 			{
 				iset_async<T>();
@@ -70,6 +105,32 @@ namespace corsl
 				iset_async<T>(std::forward<V>(v));
 			}
 
+			// Resumes the awaiting coroutine, if any, on the calling thread before returning
+			void set_inline() noexcept
+			{
+				iset_on<T>(inline_executor{});
+			}
+
+			template<class V>
+			void set_inline(V &&v) noexcept
+			{
+				iset_on<T>(inline_executor{}, std::forward<V>(v));
+			}
+
+			// Resumes the awaiting coroutine, if any, on a given executor. If the executor fails to schedule it,
+			// the coroutine is resumed on the calling thread
+			template<executor E>
+			void set_on(const E &e) noexcept
+			{
+				iset_on<T>(e);
+			}
+
+			template<executor E, class V>
+			void set_on(const E &e, V &&v) noexcept
+			{
+				iset_on<T>(e, std::forward<V>(v));
+			}
+
 			void set_exception(std::exception_ptr &&ex) noexcept
 			{
 				promise_->internal_set_exception_async(std::move(ex));
@@ -80,6 +141,17 @@ namespace corsl
 				promise_->internal_set_exception_async(std::move(ex));
 			}
 
+			void set_exception_inline(std::exception_ptr &&ex) noexcept
+			{
+				promise_->internal_set_exception_on(inline_executor{}, std::move(ex));
+			}
+
+			template<executor E>
+			void set_exception_on(const E &e, std::exception_ptr &&ex) noexcept
+			{
+				promise_->internal_set_exception_on(e, std::move(ex));
+			}
+
 			future<T> get_future() const noexcept
 			{
 				return promise_->get_return_object();
@@ -8,8 +8,6 @@
 
 #pragma once
 
-#include <vector>
-
 #include "future.h"
 #include "compatible_base.h"
 
@@ -17,120 +15,205 @@ namespace corsl
 {
 	namespace details
 	{
-		template<class T>
-		class shared_future_impl
+		// Shared state is installed into the wrapped future as its completion node, so the value is published directly
+		// by the thread that completes the future. Awaiting coroutines form an intrusive lock-free stack of nodes that
+		// live in their own frames. Combinators put their own completion nodes on the same stack
+		template<class T, class Scheduler>
+		class shared_future_impl : completion_node
 		{
-			enum class mode
+			using executor_type = executor_t<Scheduler>;
+
+			// Node of an awaiting coroutine, it has no callback
+			struct waiter : completion_node
 			{
-				not_started,
-				started,
-				ready
+				std::coroutine_handle<> handle;
 			};
 
+			static constexpr uintptr_t waiters_ready = 1;
+			static constexpr size_t inline_waiters = 16;	// larger lists of waiters are collected in a vector
+
 			future<T> future_;
-			srwlock lock;
-			mode mode { mode::not_started };
-			std::vector<std::coroutine_handle<>> continuations;
+			std::atomic<uintptr_t> waiters{ 0 };	// top of waiter stack or waiters_ready
+			std::atomic<int> use_count{ 2 };	// one for the owner, one is released when the future completes
+			[[no_unique_address]] executor_type executor;
 
-			fire_and_forget<> start()
+			static void complete(completion_node *node) noexcept
 			{
-				co_await resume_background();
-				try
-				{
-					co_await future_;
-				}
-				catch (...)
-				{
-				}
-
-				std::unique_lock<srwlock> l{ lock };
-				mode = mode::ready;
-				auto existing_continuations{ std::move(continuations) };
-				l.unlock();
-				for (auto handle : existing_continuations)
-					resume_on_background(handle);
+				const auto self = static_cast<shared_future_impl *>(node);
+				const auto top = self->waiters.exchange(waiters_ready, std::memory_order_acq_rel);
+				self->waiters.notify_all();
+				self->resume_waiters(reinterpret_cast<completion_node *>(top));
+				self->release();
 			}
 
-			corsl::future<> get_wait_future()
+			void resume_waiters(completion_node *top) noexcept
 			{
-				try
+				// resume in the order of arrival
+				completion_node *list{};
+				size_t count = 0;
+				while (top)
 				{
-					co_await *this;
+					list = std::exchange(top, std::exchange(top->next, list));
+					++count;
 				}
-				catch (...)
+
+				// all waiters are handed over to the executor in one operation
+				std::array<std::coroutine_handle<>, inline_waiters> local;
+				std::vector<std::coroutine_handle<>> heap;
+				std::span<std::coroutine_handle<>> handles{ local };
+				if (count > local.size())
+				{
+					heap.resize(count);
+					handles = heap;
+				}
+
+				size_t waiters = 0;
+				while (list)
 				{
+					// the node is destroyed as soon as it is run or its coroutine is resumed
+					const auto node = std::exchange(list, list->next);
+					if (node->on_complete)
+						node->on_complete(node);
+					else
+						handles[waiters++] = static_cast<waiter *>(node)->handle;
 				}
+				if (waiters)
+					schedule_bulk(executor, handles.first(waiters));
 			}
 
 		public:
-			shared_future_impl(future<T> &&future_) noexcept :
-				future_{ std::move(future_) }
+			shared_future_impl(future<T> &&future_, const executor_type &executor) noexcept :
+				completion_node{ &complete },
+				future_{ std::move(future_) },
+				executor{ executor }
 			{
+				assert(this->future_ && "shared_future cannot be constructed from uninitialized future");
+				if (!this->future_.promise_->set_node(*this))
+					complete(this);
 			}
 
 			shared_future_impl(const shared_future_impl &) = delete;
 			shared_future_impl &operator =(const shared_future_impl &) = delete;
 
-			bool is_ready() const noexcept
+			void add_ref() noexcept
 			{
-				return future_.is_ready();
+				use_count.fetch_add(1, std::memory_order_relaxed);
 			}
 
-			auto get()
+			void release() noexcept
 			{
-				wait();
-				return future_.get();
+				if (1 == use_count.fetch_sub(1, std::memory_order_acq_rel))
+					delete this;
 			}
 
-			void wait() noexcept
+			bool is_ready() const noexcept
 			{
-				if (!is_ready())
-					get_wait_future().wait();
+				return waiters.load(std::memory_order_acquire) == waiters_ready;
 			}
 
-			// await
-			bool await_ready() noexcept
+			// Returns false if the value is already available
+			bool push(completion_node &node) noexcept
 			{
-				std::unique_lock<srwlock> l{ lock };
-				if (mode == mode::ready)
-					return true;
-				else
+				auto top = waiters.load(std::memory_order_acquire);
+				do
 				{
-					l.release();
-					return false;
-				}
+					if (top == waiters_ready)
+						return false;
+					node.next = reinterpret_cast<completion_node *>(top);
+				} while (!waiters.compare_exchange_weak(top, reinterpret_cast<uintptr_t>(&node), std::memory_order_release, std::memory_order_acquire));
+				return true;
 			}
 
-			void await_suspend(std::coroutine_handle<> resume)
+			void wait() const noexcept
 			{
-				std::unique_lock<srwlock> l{ lock, std::adopt_lock };
-				continuations.emplace_back(resume);
-				if (mode == mode::not_started)
-				{
-					mode = mode::started;
-					start();
-				}
+				for (auto top = waiters.load(std::memory_order_acquire); top != waiters_ready; top = waiters.load(std::memory_order_acquire))
+					waiters.wait(top, std::memory_order_acquire);
 			}
 
-			auto await_resume()
+			decltype(auto) get() const
 			{
-				return future_.get();
+				wait();
+				return value();
 			}
+
+			// The value is shared by all awaiters and is never moved out
+			decltype(auto) value() const
+			{
+				if constexpr (std::same_as<void, T>)
+					future_.promise_->get_shared();
+				else
+					return future_.promise_->get_shared();
+			}
+
+			class awaiter : waiter
+			{
+				shared_future_impl *impl;
+
+			public:
+				awaiter(shared_future_impl *impl) noexcept :
+					waiter{},
+					impl{ impl }
+				{}
+
+				bool await_ready() const noexcept
+				{
+					return impl->is_ready();
+				}
+
+				bool await_suspend(std::coroutine_handle<> resume) noexcept
+				{
+					this->handle = resume;
+					return impl->push(*this);
+				}
+
+				decltype(auto) await_resume() const
+				{
+					return impl->value();
+				}
+			};
 		};
 
-		template<class T = void>
+		// Scheduler is either a callback policy or an executor used to resume awaiters
+		template<class T = void, class Scheduler = callback_policy::empty>
 		class shared_future
 		{
-			std::shared_ptr<shared_future_impl<T>> pimpl;
+			using executor_type = executor_t<Scheduler>;
+			using impl_type = shared_future_impl<T, Scheduler>;
+
+			impl_type *pimpl{};
 
 		public:
 			using result_type = T;
 
 			shared_future() = default;
-			shared_future(future<T> &&future) :
-				pimpl{ std::make_shared<shared_future_impl<T>>(std::move(future)) }
+			shared_future(future<T> &&future, const executor_type &executor = {}) :
+				pimpl{ new impl_type{ std::move(future), executor } }
 			{}
 
+			shared_future(const shared_future &o) noexcept :
+				pimpl{ o.pimpl }
+			{
+				if (pimpl)
+					pimpl->add_ref();
+			}
+
+			shared_future(shared_future &&o) noexcept :
+				pimpl{ std::exchange(o.pimpl, nullptr) }
+			{
+			}
+
+			shared_future &operator =(shared_future o) noexcept
+			{
+				std::swap(pimpl, o.pimpl);
+				return *this;
+			}
+
+			~shared_future()
+			{
+				if (pimpl)
+					pimpl->release();
+			}
+
 			explicit operator bool() const noexcept
 			{
 				return !!pimpl;
@@ -141,11 +224,7 @@ namespace corsl
 				return pimpl->is_ready();
 			}
 
-			decltype(auto) get()
-			{
-				return pimpl->get();
-			}
-
+			// Returns a reference to the shared value, valid while any copy of this shared_future exists
 			decltype(auto) get() const
 			{
 				return pimpl->get();
@@ -156,20 +235,17 @@ namespace corsl
 				pimpl->wait();
 			}
 
-			// await
-			bool await_ready() const noexcept
-			{
-				return pimpl->await_ready();
-			}
-
-			void await_suspend(std::coroutine_handle<> resume) const
+			// Runs the node in the thread that completes the future.
+			// Returns false if the value is already available, the node is not run in this case
+			bool set_node(completion_node &node) noexcept
 			{
-				pimpl->await_suspend(resume);
+				return pimpl->push(node);
 			}
 
-			auto await_resume() const
+			// Awaiting produces a reference to the shared value as well
+			typename impl_type::awaiter operator co_await() const noexcept
 			{
-				return pimpl->await_resume();
+				return { pimpl };
 			}
 
 			template<class F>
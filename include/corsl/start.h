@@ -32,16 +32,23 @@ namespace corsl
 			return istart(get_result_type_t<Awaitable>{}, std::forward<Awaitable>(awaitable));
 		}
 
+		// Futures are waited for directly, other awaitables are wrapped into a future first
 		template<class Awaitable>
 		inline auto block_get(Awaitable &&awaitable)
 		{
-			return start(std::forward<Awaitable>(awaitable)).get();
+			if constexpr (is_future_v<std::remove_cvref_t<Awaitable>>)
+				return std::forward<Awaitable>(awaitable).get();
+			else
+				return start(std::forward<Awaitable>(awaitable)).get();
 		}
 
 		template<class Awaitable>
 		inline void block_wait(Awaitable &&awaitable) noexcept
 		{
-			start(std::forward<Awaitable>(awaitable)).wait();
+			if constexpr (is_future_v<std::remove_cvref_t<Awaitable>>)
+				awaitable.wait();
+			else
+				start(std::forward<Awaitable>(awaitable)).wait();
 		}
 	}
 	using details::start;
@@ -0,0 +1,191 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "future.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		template<class T = void>
+		class task;
+
+		// Lazy task does not start until awaited, so the continuation is always known when coroutine finishes
+		// and no synchronization is required
+		template<class value_type>
+		struct __declspec(empty_bases) task_promise_common : promise_base0, frame_allocation_base
+		{
+			std::variant<std::monostate, std::exception_ptr, value_type> value;
+			std::coroutine_handle<> continuation{};
+
+			static std::suspend_always initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			struct final_awaiter
+			{
+				static bool await_ready() noexcept
+				{
+					return false;
+				}
+
+				template<class Promise>
+				static std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+				{
+					if (auto continuation = handle.promise().continuation)
+						return continuation;
+					return std::noop_coroutine();
+				}
+
+				static void await_resume() noexcept
+				{
+				}
+			};
+
+			static final_awaiter final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void unhandled_exception() noexcept
+			{
+				value = std::current_exception();
+			}
+
+			value_type &get()
+			{
+				if (std::holds_alternative<std::exception_ptr>(value)) [[unlikely]]
+					std::rethrow_exception(std::get<std::exception_ptr>(std::move(value)));
+				return *std::get_if<value_type>(&value);
+			}
+
+			template<class V>
+			V &&await_transform(V &&expr)
+			{
+				if (this->is_cancelled()) [[unlikely]]
+					throw operation_cancelled{};
+				else
+					return std::forward<V>(expr);
+			}
+
+			corsl::details::cancellation_token_transport await_transform(corsl::details::cancellation_source &source) noexcept
+			{
+				return { source, std::coroutine_handle<promise_base0>::from_promise(*this) };
+			}
+
+			corsl::details::cancellation_token_transport await_transform(const corsl::details::cancellation_source &source) noexcept
+			{
+				return { source, std::coroutine_handle<promise_base0>::from_promise(*this) };
+			}
+		};
+
+		template<class T>
+		struct __declspec(empty_bases) task_promise : task_promise_common<T>
+		{
+			task<T> get_return_object() noexcept;
+
+			template<class V>
+			void return_value(V &&v) noexcept
+			{
+				this->value = std::forward<V>(v);
+			}
+		};
+
+		template<>
+		struct __declspec(empty_bases) task_promise<void> : task_promise_common<empty_type>
+		{
+			task<void> get_return_object() noexcept;
+
+			void return_void() noexcept
+			{
+				value = empty_type{};
+			}
+		};
+
+		template<class T>
+		class task
+		{
+			friend struct task_promise<T>;
+			static_assert(!std::is_reference_v<T>, "task<T> is not allowed for reference types");
+
+			std::coroutine_handle<task_promise<T>> coro{};
+
+			task(std::coroutine_handle<task_promise<T>> coro) noexcept :
+				coro{ coro }
+			{}
+
+		public:
+			using promise_type = task_promise<T>;
+			using result_type = T;
+
+			task() noexcept = default;
+
+			task(const task &) = delete;
+			task &operator =(const task &) = delete;
+
+			task(task &&o) noexcept :
+				coro{ std::exchange(o.coro, {}) }
+			{}
+
+			task &operator =(task &&o) noexcept
+			{
+				std::swap(coro, o.coro);
+				return *this;
+			}
+
+			~task()
+			{
+				if (coro)
+					coro.destroy();
+			}
+
+			explicit operator bool() const noexcept
+			{
+				return !!coro;
+			}
+
+			// await
+			bool await_ready() const noexcept
+			{
+				assert(coro && "co_await with uninitialized task is invalid");
+				return false;
+			}
+
+			// Starts the task, it will transfer control back to the awaiting coroutine when finished
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> resume) noexcept
+			{
+				coro.promise().continuation = resume;
+				return coro;
+			}
+
+			decltype(auto) await_resume()
+			{
+				if constexpr (std::same_as<void, T>)
+					coro.promise().get();
+				else
+					return std::move(coro.promise().get());
+			}
+		};
+
+		template<class T>
+		inline task<T> task_promise<T>::get_return_object() noexcept
+		{
+			return { std::coroutine_handle<task_promise>::from_promise(*this) };
+		}
+
+		inline task<void> task_promise<void>::get_return_object() noexcept
+		{
+			return { std::coroutine_handle<task_promise>::from_promise(*this) };
+		}
+	}
+
+	using details::task;
+}
@@ -16,20 +16,28 @@ namespace corsl
 {
 	namespace details
 	{
-		template<class CallbackPolicy = callback_policy::empty>
+		// Scheduler is either a callback policy or an executor used to resume the waiting coroutine
+		template<class Scheduler = callback_policy::empty>
 		class tp_timer
 		{
+			using executor_type = executor_t<Scheduler>;
+			using policy_type = callback_policy_t<Scheduler>;
+
+			// Timer callback already runs on the thread pool, other executors get the continuation handed over
+			static constexpr bool schedule_on_expiry = !std::is_same_v<executor_type, thread_pool_executor<policy_type>>;
+
 			winrt::handle_type<timer_traits> timer;
 			srwlock lock;
 			std::coroutine_handle<> resume_location{};
 			bool cancellation_requested{ false };
+			[[no_unique_address]] executor_type executor;
 
 			//
 			tp_timer(PTP_CALLBACK_ENVIRON pce) noexcept :
 				timer{ CreateThreadpoolTimer([](PTP_CALLBACK_INSTANCE pci, void * context, PTP_TIMER) noexcept
 			{
-				CallbackPolicy::init_callback(pci);
-				static_cast<tp_timer *>(context)->resume(false);
+				policy_type::init_callback(pci);
+				static_cast<tp_timer *>(context)->resume(schedule_on_expiry);
 			}, this, pce) }
 			{
 			}
@@ -42,43 +50,63 @@ namespace corsl
 				{
 					l.unlock();
 					if (background)
-						resume_on_background<CallbackPolicy>(continuation);
+						executor.schedule(continuation);
 					else
 						continuation();
 				}
 			}
 
-			void check_cancellation(std::unique_lock<srwlock> &l)
+			bool take_cancellation() noexcept
 			{
-				if (cancellation_requested)
-				{
-					cancellation_requested = false;
-					l.unlock();
-					throw timer_cancelled{};
-				}
+				std::scoped_lock l{ lock };
+				return std::exchange(cancellation_requested, false);
 			}
 
-			void check_exception()
+			// Returns false without suspending if the timer has been cancelled
+			bool suspend(std::coroutine_handle<> handle) noexcept
 			{
-				lock.lock();
+				std::scoped_lock l{ lock };
 				if (cancellation_requested)
-				{
-					cancellation_requested = false;
-					lock.unlock();
-					throw timer_cancelled{};
-				}
-				else
-					lock.unlock();
-			}
-
-			void suspend(std::coroutine_handle<> handle)
-			{
-				std::unique_lock l{ lock };
-				check_cancellation(l);
+					return false;
 				assert(!resume_location);
 				resume_location = handle;
+				return true;
 			}
 
+			// Non-throwing awaiter reports cancellation as std::expected error
+			template<bool nothrow>
+			class awaiter
+			{
+				tp_timer *timer;
+
+			public:
+				awaiter(tp_timer *timer) noexcept :
+					timer{ timer }
+				{}
+
+				bool await_ready() const noexcept
+				{
+					return false;
+				}
+
+				bool await_suspend(std::coroutine_handle<> handle) noexcept
+				{
+					return timer->suspend(handle);
+				}
+
+				auto await_resume() const noexcept(nothrow)
+				{
+					if constexpr (nothrow)
+					{
+						if (timer->take_cancellation()) [[unlikely]]
+							return std::expected<void, HRESULT>{ std::unexpect, cancellation_error<HRESULT>::get() };
+						return std::expected<void, HRESULT>{};
+					}
+					else if (timer->take_cancellation()) [[unlikely]]
+						throw timer_cancelled{};
+				}
+			};
+
 		public:
 			tp_timer(callback_environment &ce) noexcept : tp_timer(ce.get())
 			{
@@ -88,34 +116,19 @@ namespace corsl
 			{
 			}
 
-			auto wait() noexcept
+			explicit tp_timer(const executor_type &executor) noexcept : tp_timer(nullptr)
 			{
-				class awaiter
-				{
-					tp_timer *timer;
-
-				public:
-					awaiter(tp_timer *timer) noexcept :
-						timer{ timer }
-					{}
-
-					bool await_ready() const noexcept
-					{
-						return false;
-					}
-
-					void await_suspend(std::coroutine_handle<> handle)
-					{
-						timer->suspend(handle);
-					}
+				this->executor = executor;
+			}
 
-					void await_resume() const
-					{
-						timer->check_exception();
-					}
-				};
+			awaiter<false> wait() noexcept
+			{
+				return { this };
+			}
 
-				return awaiter{ this };
+			awaiter<true> wait(std::nothrow_t) noexcept
+			{
+				return { this };
 			}
 
 			void cancel() noexcept
@@ -157,7 +170,7 @@ namespace corsl
 			}
 		};
 	}
-	template<class CallbackPolicy>
-	using tp_timer_ex = details::tp_timer<CallbackPolicy>;
+	template<class Scheduler>
+	using tp_timer_ex = details::tp_timer<Scheduler>;
 	using tp_timer = details::tp_timer<>;
 }
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "impl/when_all_when_any_base.h"
+#include "cancel.h"
 
 namespace corsl
 {
@@ -38,10 +39,53 @@ namespace corsl
 			}
 		}
 
-		template<class Master, class Tuple, size_t...I>
-		inline void when_all_helper(Master &master, Tuple &&tuple, std::index_sequence<I...>) noexcept
+		// Passes the result of a completed node_awaitable to the master
+		template<size_t Index, class Master, class Awaitable>
+		inline void when_all_deliver(Master &master, Awaitable &task) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<result_type<void>, get_result_type_t<Awaitable>>)
+				{
+					get_ready_result(task);
+					master.finished(std::integral_constant<size_t, Index>{});
+				}
+				else
+				{
+					master.finished(std::integral_constant<size_t, Index>{}, get_ready_result(task));
+				}
+			}
+			catch (...)
+			{
+				master.finished_exception();
+			}
+		}
+
+		// Library awaitables stay in the master and get its completion node, other awaitables are moved to helper coroutines
+		template<size_t Index, class Master>
+		inline void when_all_start_single(Master &master) noexcept
+		{
+			auto &task = std::get<Index>(master.awaitables);
+			if constexpr (node_awaitable<std::decay_t<decltype(task)>>)
+			{
+				auto &node = master.nodes[Index];
+				node.on_complete = [](completion_node *node) noexcept
+				{
+					auto &master = *static_cast<Master *>(static_cast<child_node *>(node)->master);
+					when_all_deliver<Index>(master, std::get<Index>(master.awaitables));
+				};
+				node.master = &master;
+				if (!task.set_node(node))
+					node.on_complete(&node);
+			}
+			else
+				when_all_helper_single<Index>(master, std::move(task));
+		}
+
+		template<class Master, size_t...I>
+		inline void when_all_helper(Master &master, std::index_sequence<I...>) noexcept
 		{
-			[[maybe_unused]] auto x = { when_all_helper_single<I>(master, std::get<I>(std::move(tuple)))... };
+			(..., when_all_start_single<I>(master));
 		}
 
 		template<class...Awaitables>
@@ -51,10 +95,13 @@ namespace corsl
 			std::atomic<int> counter;
 			std::coroutine_handle<> resume;
 			std::tuple<std::decay_t<Awaitables>...> awaitables;
+			std::array<child_node, sizeof...(Awaitables)> nodes;
 
+			// await_suspend holds an extra count while it starts children, so the awaiting coroutine is never resumed
+			// from its own await_suspend
 			when_all_awaitable_base(Awaitables &&...awaitables) noexcept :
 				awaitables{ std::forward<Awaitables>(awaitables)... },
-				counter{ sizeof...(awaitables) }
+				counter{ sizeof...(awaitables) + 1 }
 			{}
 
 			when_all_awaitable_base(when_all_awaitable_base &&o) noexcept :
@@ -73,10 +120,16 @@ namespace corsl
 
 			void check_resume() noexcept
 			{
-				if (0 == counter.fetch_sub(1, std::memory_order_relaxed) - 1)
+				if (1 == counter.fetch_sub(1, std::memory_order_acq_rel))
 					resume();
 			}
 
+			// Releases the count held by await_suspend, returns false if all children have already completed
+			bool started() noexcept
+			{
+				return 1 != counter.fetch_sub(1, std::memory_order_acq_rel);
+			}
+
 			bool await_ready() const noexcept
 			{
 				return false;
@@ -103,10 +156,11 @@ namespace corsl
 				this->check_resume();
 			}
 
-			void await_suspend(std::coroutine_handle<> handle) noexcept
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
 			{
 				this->resume = handle;
-				when_all_helper(*this, std::move(this->awaitables), std::make_index_sequence<sizeof...(Awaitables)>{});
+				when_all_helper(*this, std::make_index_sequence<sizeof...(Awaitables)>{});
+				return this->started();
 			}
 
 			void await_resume() const
@@ -147,10 +201,11 @@ namespace corsl
 				this->check_resume();
 			}
 
-			void await_suspend(std::coroutine_handle<> handle) noexcept
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
 			{
 				this->resume = handle;
-				when_all_helper(*this, this->awaitables, std::make_index_sequence<sizeof...(Awaitables)>{});
+				when_all_helper(*this, std::make_index_sequence<sizeof...(Awaitables)>{});
+				return this->started();
 			}
 
 			results_t await_resume()
@@ -177,31 +232,69 @@ namespace corsl
 
 		// 2. Range version
 		// Awaitables are passed as ranges
-		template<class Awaitable>
+
+		// Children are started on the awaiting thread
+		struct serial_launch {};
+
+		// Children are started by chunks of chunk_size. The first chunk is started on the awaiting thread, the rest are
+		// started from executor's workers. Shortens the launch phase of large ranges of awaitables with heavy synchronous
+		// prologues
+		template<executor E = thread_pool_executor<>>
+		struct parallel_launch
+		{
+			size_t chunk_size{ 1024 };
+			[[no_unique_address]] E executor{};
+		};
+
+		// Chunk's guard in the master's counter keeps the master alive until the whole chunk is started.
+		// If the executor fails to accept the chunk, it is started on the awaiting thread
+		template<class Master, class E>
+		inline fire_and_forget<> when_all_launch_chunk(Master &master, E executor, size_t begin, size_t end) noexcept
+		{
+			try
+			{
+				co_await resume_background(executor);
+			}
+			catch (...)
+			{
+			}
+			master.start_children(begin, end);
+			master.check_resume();
+		}
+
+		template<class Awaitable, class Launch>
 		struct range_when_all_awaitable_base
 		{
 			std::exception_ptr exception;
 			std::vector<Awaitable> tasks_;
+			std::vector<child_node> nodes;	// allocated only for library awaitables
 			std::atomic<int> counter;
 			std::coroutine_handle<> resume;
+			[[no_unique_address]] Launch launch;
 
 			template<sr::range Range>
-			range_when_all_awaitable_base(Range &&range) requires !std::copyable<Awaitable> :
+			range_when_all_awaitable_base(Range &&range, Launch launch) requires !std::copyable<Awaitable> :
 				tasks_{ std::make_move_iterator(sr::begin(range)), std::make_move_iterator(sr::end(range)) },
-				counter{ static_cast<int>(tasks_.size()) }
+				nodes(node_awaitable<Awaitable> ? tasks_.size() : 0),
+				counter{ static_cast<int>(tasks_.size()) + 1 },
+				launch{ std::move(launch) }
 			{}
 
 			template<sr::range Range>
-			range_when_all_awaitable_base(Range &&range) requires std::copyable<Awaitable> :
+			range_when_all_awaitable_base(Range &&range, Launch launch) requires std::copyable<Awaitable> :
 				tasks_{ sr::begin(range), sr::end(range) },
-				counter{ static_cast<int>(tasks_.size()) }
+				nodes(node_awaitable<Awaitable> ? tasks_.size() : 0),
+				counter{ static_cast<int>(tasks_.size()) + 1 },
+				launch{ std::move(launch) }
 			{}
 
 			range_when_all_awaitable_base(range_when_all_awaitable_base &&o) noexcept :
 				exception{ std::move(o.exception) },
 				tasks_{ std::move(o.tasks_) },
+				nodes{ std::move(o.nodes) },
 				counter{ o.counter.load(std::memory_order_relaxed) },
-				resume{ std::move(o.resume) }
+				resume{ std::move(o.resume) },
+				launch{ std::move(o.launch) }
 			{}
 
 			range_when_all_awaitable_base &operator =(range_when_all_awaitable_base &&o) noexcept
@@ -209,8 +302,10 @@ namespace corsl
 				using std::swap;
 				swap(exception, o.exception);
 				swap(tasks_, o.tasks_);
+				swap(nodes, o.nodes);
 				swap(resume, o.resume);
-				counter.store(o.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				swap(launch, o.launch);
+				counter.store(o.counter.load(std::memory_order_relaxed), std::memory_order_relaxed);
 
 				return *this;
 			}
@@ -224,22 +319,67 @@ namespace corsl
 
 			void check_resume() noexcept
 			{
-				if (0 == counter.fetch_sub(1, std::memory_order_relaxed) - 1)
+				if (1 == counter.fetch_sub(1, std::memory_order_acq_rel))
 					resume();
 			}
 
+			bool started() noexcept
+			{
+				return 1 != counter.fetch_sub(1, std::memory_order_acq_rel);
+			}
+
+			// Library awaitables stay in tasks_ and get completion nodes which pass their results to Deliver
+			template<auto Deliver, class Master>
+			void start_nodes(Master &master, size_t begin, size_t end) noexcept
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					auto &node = nodes[i];
+					node.on_complete = [](completion_node *node) noexcept
+					{
+						const auto child = static_cast<child_node *>(node);
+						auto &master = *static_cast<Master *>(child->master);
+						Deliver(master, master.tasks_[child->index], child->index);
+					};
+					node.master = &master;
+					node.index = i;
+					if (!tasks_[i].set_node(node))
+						node.on_complete(&node);
+				}
+			}
+
+			// Master's start_children starts children in the given index range
+			template<class Master>
+			void start_all(Master &master) noexcept
+			{
+				const auto size = tasks_.size();
+				if constexpr (!std::same_as<Launch, serial_launch>)
+				{
+					const auto chunk = std::max<size_t>(launch.chunk_size, 1);
+					if (size > chunk)
+					{
+						counter.fetch_add(static_cast<int>((size - 1) / chunk), std::memory_order_relaxed);
+						for (size_t begin = chunk; begin < size; begin += chunk)
+							when_all_launch_chunk(master, launch.executor, begin, std::min(begin + chunk, size));
+						master.start_children(0, chunk);
+						return;
+					}
+				}
+				master.start_children(0, size);
+			}
+
 			bool await_ready() const noexcept
 			{
 				return tasks_.empty();
 			}
 		};
 
-		template<class Awaitable>
-		struct range_when_all_awaitable_void : range_when_all_awaitable_base<Awaitable>
+		template<class Awaitable, class Launch = serial_launch>
+		struct range_when_all_awaitable_void : range_when_all_awaitable_base<Awaitable, Launch>
 		{
 			template<sr::range Range>
-			range_when_all_awaitable_void(Range &&range) :
-				range_when_all_awaitable_base<Awaitable>{ std::forward<Range>(range) }
+			range_when_all_awaitable_void(Range &&range, Launch launch = {}) :
+				range_when_all_awaitable_base<Awaitable, Launch>{ std::forward<Range>(range), std::move(launch) }
 			{}
 
 			template<size_t N>
@@ -248,12 +388,27 @@ namespace corsl
 				this->check_resume();
 			}
 
-			void await_suspend(std::coroutine_handle<> handle) noexcept
+			static void deliver(range_when_all_awaitable_void &master, Awaitable &task, size_t) noexcept
+			{
+				when_all_deliver<0>(master, task);
+			}
+
+			void start_children(size_t begin, size_t end) noexcept
+			{
+				if constexpr (node_awaitable<Awaitable>)
+					this->template start_nodes<&deliver>(*this, begin, end);
+				else
+				{
+					for (size_t i = begin; i < end; ++i)
+						when_all_helper_single<0>(*this, std::move(this->tasks_[i]));
+				}
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
 			{
-				auto tasks{ std::move(this->tasks_) };
 				this->resume = handle;
-				for (auto &task : tasks)
-					when_all_helper_single<0>(*this, std::move(task));
+				this->start_all(*this);
+				return this->started();
 			}
 
 			void await_resume() const
@@ -277,16 +432,16 @@ namespace corsl
 			};
 		}
 
-		template<class Awaitable>
-		struct range_when_all_awaitable_value : range_when_all_awaitable_base<Awaitable>
+		template<class Awaitable, class Launch = serial_launch>
+		struct range_when_all_awaitable_value : range_when_all_awaitable_base<Awaitable, Launch>
 		{
 			using result_type = get_result_type_t<Awaitable>;
 			using results_t = std::vector<std::decay_t<typename result_type::type>>;
 			results_t results;
 
 			template<sr::range Range>
-			range_when_all_awaitable_value(Range &&range) :
-				range_when_all_awaitable_base<Awaitable>{ std::forward<Range>(range) },
+			range_when_all_awaitable_value(Range &&range, Launch launch = {}) :
+				range_when_all_awaitable_base<Awaitable, Launch>{ std::forward<Range>(range), std::move(launch) },
 				results(this->tasks_.size())
 			{}
 
@@ -297,13 +452,34 @@ namespace corsl
 				this->check_resume();
 			}
 
-			void await_suspend(std::coroutine_handle<> handle) noexcept
+			static void deliver(range_when_all_awaitable_value &master, Awaitable &task, size_t index) noexcept
+			{
+				try
+				{
+					master.finished(index, get_ready_result(task));
+				}
+				catch (...)
+				{
+					master.finished_exception();
+				}
+			}
+
+			void start_children(size_t begin, size_t end) noexcept
+			{
+				if constexpr (node_awaitable<Awaitable>)
+					this->template start_nodes<&deliver>(*this, begin, end);
+				else
+				{
+					for (size_t i = begin; i < end; ++i)
+						range_when_all_helper_single(*this, std::move(this->tasks_[i]), i);
+				}
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
 			{
 				this->resume = handle;
-				auto tasks{ std::move(this->tasks_) };
-				this->resume = handle;
-				for (size_t i = 0; i < tasks.size(); ++i)
-					range_when_all_helper_single(*this, std::move(tasks[i]), i);
+				this->start_all(*this);
+				return this->started();
 			}
 
 			results_t await_resume()
@@ -325,8 +501,290 @@ namespace corsl
 			else
 				return range_when_all_awaitable_value<future_type> { std::forward<Range>(range) };
 		}
+
+		template<sr::range Range, executor E>
+		inline auto when_all_range(Range &&range, parallel_launch<E> launch)
+		{
+			using future_type = std::decay_t<sr::range_value_t<Range>>;
+			using type = get_result_type_t<future_type>;
+			if constexpr (std::same_as<result_type<void>, type>)
+				return range_when_all_awaitable_void<future_type, parallel_launch<E>> { std::forward<Range>(range), std::move(launch) };
+			else
+				return range_when_all_awaitable_value<future_type, parallel_launch<E>> { std::forward<Range>(range), std::move(launch) };
+		}
+
+		// 3. Fail-fast version
+		// The awaiting coroutine is resumed with the first exception, the rest of the children are cancelled. Shared state
+		// owns the children and their results, so children that are still running may safely complete later
+		template<class Results, class Tasks, class Nodes>
+		struct fail_fast_state
+		{
+			std::atomic<std::coroutine_handle<>> resume{};	// taken by the last completed child or by the first failed one
+			std::atomic<int> counter{ 0 };	// children left, plus one held by await_suspend
+			std::exception_ptr exception;
+			[[no_unique_address]] Results results;
+			Tasks tasks;
+			Nodes nodes;
+			std::optional<cancellation_source> source;
+
+			template<class...Args>
+			fail_fast_state(Args &&...args) :
+				tasks(std::forward<Args>(args)...)
+			{}
+
+			void check_resume() noexcept
+			{
+				if (1 == counter.fetch_sub(1, std::memory_order_acq_rel))
+				{
+					if (auto continuation = resume.exchange(nullptr, std::memory_order_acquire))
+						continuation();
+				}
+			}
+
+			// Returns false if the awaiting coroutine should not suspend
+			bool started() noexcept
+			{
+				return 1 != counter.fetch_sub(1, std::memory_order_acq_rel) || !resume.exchange(nullptr, std::memory_order_acquire);
+			}
+
+			void finished_exception() noexcept
+			{
+				if (auto continuation = resume.exchange(nullptr, std::memory_order_acq_rel))
+				{
+					exception = std::current_exception();
+					if (source)
+						source->cancel();
+					cancel_children(tasks);
+					continuation();
+				}
+			}
+
+			template<class Index>
+			void finished(Index) noexcept
+			{
+				check_resume();
+			}
+
+			template<class Index, class V>
+			void finished(Index index, V &&value) noexcept
+			{
+				if constexpr (sr::range<Results>)
+					results[index] = std::forward<V>(value);
+				else if constexpr (!std::same_as<Results, no_result>)
+					std::get<Index::value>(results) = std::forward<V>(value);
+				check_resume();
+			}
+		};
+
+		template<class State, class Awaitable, class Index>
+		inline fire_and_forget<> fail_fast_helper_single(std::shared_ptr<State> state, Awaitable task, Index index) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<result_type<void>, get_result_type_t<Awaitable>>)
+				{
+					co_await task;
+					state->finished(index);
+				}
+				else
+				{
+					state->finished(index, co_await task);
+				}
+			}
+			catch (...)
+			{
+				state->finished_exception();
+			}
+		}
+
+		template<class State, class Awaitable, class Index>
+		inline void fail_fast_deliver(State &state, Awaitable &task, Index index) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<result_type<void>, get_result_type_t<Awaitable>>)
+				{
+					get_ready_result(task);
+					state.finished(index);
+				}
+				else
+				{
+					state.finished(index, get_ready_result(task));
+				}
+			}
+			catch (...)
+			{
+				state.finished_exception();
+			}
+		}
+
+		// Index is std::integral_constant for a tuple of children and size_t for a range
+		template<class Index, class Tasks>
+		inline auto &get_task(Tasks &tasks, Index index) noexcept
+		{
+			if constexpr (sr::range<Tasks>)
+				return tasks[index];
+			else
+				return std::get<Index::value>(tasks);
+		}
+
+		template<class State, class Index>
+		inline void fail_fast_start_single(const std::shared_ptr<State> &state, Index index) noexcept
+		{
+			auto &task = get_task(state->tasks, index);
+			if constexpr (node_awaitable<std::remove_reference_t<decltype(task)>>)
+			{
+				auto &node = state->nodes[index];
+				node.on_complete = [](completion_node *node) noexcept
+				{
+					const auto child = static_cast<shared_child_node *>(node);
+					const auto master = std::move(child->master);
+					auto &state = *static_cast<State *>(master.get());
+					if constexpr (std::same_as<Index, size_t>)
+						fail_fast_deliver(state, state.tasks[child->index], child->index);
+					else
+						fail_fast_deliver(state, get_task(state.tasks, Index{}), Index{});
+				};
+				node.master = state;
+				node.index = index;
+				if (!task.set_node(node))
+					node.on_complete(&node);
+			}
+			else
+				fail_fast_helper_single(state, std::move(task), index);
+		}
+
+		template<class State>
+		struct fail_fast_awaitable_base
+		{
+			std::shared_ptr<State> ptr;
+
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			void link(const cancellation_source &source)
+			{
+				ptr->source = source;
+			}
+
+			auto await_resume()
+			{
+				if (ptr->exception)
+					std::rethrow_exception(ptr->exception);
+				if constexpr (!std::same_as<decltype(ptr->results), no_result>)
+					return std::move(ptr->results);
+			}
+		};
+
+		template<class Results, class...Awaitables>
+		struct when_all_fail_fast_awaitable : fail_fast_awaitable_base<fail_fast_state<Results, std::tuple<std::decay_t<Awaitables>...>, std::array<shared_child_node, sizeof...(Awaitables)>>>
+		{
+			template<class...Args>
+			when_all_fail_fast_awaitable(Args &&...args)
+			{
+				this->ptr = std::make_shared<typename decltype(this->ptr)::element_type>(std::forward<Args>(args)...);
+				this->ptr->counter.store(sizeof...(Awaitables) + 1, std::memory_order_relaxed);
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				// the awaiting coroutine may be resumed with an exception and destroy this object before all children are started
+				const auto state = this->ptr;
+				state->resume.store(handle, std::memory_order_relaxed);
+				[&]<size_t...I>(std::index_sequence<I...>)
+				{
+					(..., fail_fast_start_single(state, std::integral_constant<size_t, I>{}));
+				}(std::make_index_sequence<sizeof...(Awaitables)>{});
+				return state->started();
+			}
+		};
+
+		template<class Results, class Awaitable>
+		struct when_all_fail_fast_awaitable_range : fail_fast_awaitable_base<fail_fast_state<Results, std::vector<Awaitable>, std::vector<shared_child_node>>>
+		{
+			template<sr::range Range>
+			when_all_fail_fast_awaitable_range(Range &&range)
+			{
+				using state_t = typename decltype(this->ptr)::element_type;
+				if constexpr (std::copyable<Awaitable>)
+					this->ptr = std::make_shared<state_t>(sr::begin(range), sr::end(range));
+				else
+					this->ptr = std::make_shared<state_t>(std::make_move_iterator(sr::begin(range)), std::make_move_iterator(sr::end(range)));
+
+				const auto size = this->ptr->tasks.size();
+				if constexpr (node_awaitable<Awaitable>)
+					this->ptr->nodes.resize(size);
+				if constexpr (!std::same_as<Results, no_result>)
+					this->ptr->results.resize(size);
+				this->ptr->counter.store(static_cast<int>(size) + 1, std::memory_order_relaxed);
+			}
+
+			bool await_ready() const noexcept
+			{
+				return this->ptr->tasks.empty();
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				const auto state = this->ptr;
+				state->resume.store(handle, std::memory_order_relaxed);
+				for (size_t i = 0; i < state->tasks.size(); ++i)
+					fail_fast_start_single(state, i);
+				return state->started();
+			}
+		};
+
+		template<class T>
+		using fail_fast_result_t = std::conditional_t<std::same_as<result_type<void>, T>, no_result, std::decay_t<typename T::type>>;
+
+		template<class...Awaitables>
+		inline auto when_all_fail_fast(Awaitables &&...awaitables) requires (!std::same_as<std::remove_cvref_t<Awaitables>, cancellation_source> && ...)
+		{
+			static_assert(sizeof...(Awaitables) >= 2, "when_all_fail_fast must be passed at least two arguments");
+
+			using result_types = mp11::mp_list<get_result_type_t<Awaitables>...>;
+			using results_t = std::tuple<fail_fast_result_t<get_result_type_t<Awaitables>>...>;
+
+			if constexpr (std::same_as<result_type<void>, mp11::mp_first<result_types>> && mp11::mp_apply<mp11::mp_same, result_types>::value)
+				return when_all_fail_fast_awaitable<no_result, Awaitables...>{ std::forward<Awaitables>(awaitables)... };
+			else
+				return when_all_fail_fast_awaitable<results_t, Awaitables...>{ std::forward<Awaitables>(awaitables)... };
+		}
+
+		// The source is cancelled along with the children on the first exception
+		template<class...Awaitables>
+		inline auto when_all_fail_fast(const cancellation_source &source, Awaitables &&...awaitables)
+		{
+			auto result = when_all_fail_fast(std::forward<Awaitables>(awaitables)...);
+			result.link(source);
+			return result;
+		}
+
+		template<sr::range Range>
+		inline auto when_all_fail_fast_range(Range &&range)
+		{
+			using future_type = std::decay_t<sr::range_value_t<Range>>;
+			using type = get_result_type_t<future_type>;
+			if constexpr (std::same_as<result_type<void>, type>)
+				return when_all_fail_fast_awaitable_range<no_result, future_type>{ std::forward<Range>(range) };
+			else
+				return when_all_fail_fast_awaitable_range<std::vector<std::decay_t<typename type::type>>, future_type>{ std::forward<Range>(range) };
+		}
+
+		template<sr::range Range>
+		inline auto when_all_fail_fast_range(const cancellation_source &source, Range &&range)
+		{
+			auto result = when_all_fail_fast_range(std::forward<Range>(range));
+			result.link(source);
+			return result;
+		}
 	}
 
 	using details::when_all;
 	using details::when_all_range;
+	using details::parallel_launch;
+	using details::when_all_fail_fast;
+	using details::when_all_fail_fast_range;
 }
@@ -0,0 +1,328 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "when_all.h"
+#include "future.h"
+#include "async_generator.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		// Items of a source are either callables that start an operation or lazy awaitables. Awaitables are copied
+		// if they are copyable and moved out of the source otherwise
+		template<class Item>
+		inline auto make_bounded_child(Item &&item)
+		{
+			if constexpr (std::invocable<Item &>)
+				return std::invoke(item);
+			else if constexpr (std::copyable<std::decay_t<Item>>)
+				return std::decay_t<Item>(std::forward<Item>(item));
+			else
+				return std::decay_t<Item>(std::move(item));
+		}
+
+		template<class Item>
+		using bounded_child_t = std::decay_t<decltype(make_bounded_child(std::declval<Item>()))>;
+
+		template<class Awaitable>
+		using bounded_results_t = std::conditional_t<std::same_as<result_type<void>, get_result_type_t<Awaitable>>, no_result, std::vector<std::decay_t<typename get_result_type_t<Awaitable>::type>>>;
+
+		// Shared state of when_all_bounded. Children keep it alive, so they may complete after the driver coroutine
+		// has finished (for example, when it has been cancelled). Library awaitables occupy one of max_in_flight slots
+		// with their completion nodes, other awaitables are awaited by helper coroutines
+		template<class Awaitable>
+		struct bounded_state
+		{
+			static constexpr size_t no_slot = ~size_t{};
+			using results_t = bounded_results_t<Awaitable>;
+
+			srwlock lock;
+			const size_t max_in_flight;
+			size_t in_flight{};
+			size_t started{};
+			std::coroutine_handle<> waiting{};	// driver waiting for in_flight to drop below waiting_limit
+			size_t waiting_limit{};
+			std::exception_ptr exception;
+			[[no_unique_address]] results_t results;
+			std::vector<std::optional<Awaitable>> tasks;	// per slot
+			std::vector<shared_child_node> nodes;	// per slot, node index is the result index
+			std::vector<size_t> free_slots;
+
+			explicit bounded_state(size_t max_in_flight_) :
+				max_in_flight{ std::max<size_t>(max_in_flight_, 1) }
+			{
+				if constexpr (node_awaitable<Awaitable>)
+				{
+					tasks.resize(max_in_flight);
+					nodes.resize(max_in_flight);
+					free_slots.reserve(max_in_flight);
+					for (size_t i = max_in_flight; i--;)
+						free_slots.push_back(i);
+				}
+			}
+
+			// Called with the lock held
+			void release(std::unique_lock<srwlock> &l, size_t slot) noexcept
+			{
+				if (slot != no_slot)
+				{
+					tasks[slot].reset();
+					free_slots.push_back(slot);
+				}
+				--in_flight;
+				std::coroutine_handle<> resume{};
+				if (waiting && in_flight < waiting_limit)
+					resume = std::exchange(waiting, {});
+				l.unlock();
+				if (resume)
+					resume();
+			}
+
+			void finished(size_t slot, size_t) noexcept
+			{
+				std::unique_lock l{ lock };
+				release(l, slot);
+			}
+
+			template<class V>
+			void finished(size_t slot, size_t index, V &&value) noexcept
+			{
+				std::unique_lock l{ lock };
+				if constexpr (!std::same_as<results_t, no_result>)
+					results[index] = std::forward<V>(value);
+				release(l, slot);
+			}
+
+			void finished_exception(size_t slot) noexcept
+			{
+				std::unique_lock l{ lock };
+				if (!exception)
+					exception = std::current_exception();
+				release(l, slot);
+			}
+
+			bool failed() noexcept
+			{
+				std::scoped_lock l{ lock };
+				return !!exception;
+			}
+
+			void set_exception(std::exception_ptr &&exception_) noexcept
+			{
+				std::scoped_lock l{ lock };
+				if (!exception)
+					exception = std::move(exception_);
+			}
+
+			static void complete(completion_node *node) noexcept
+			{
+				const auto child = static_cast<shared_child_node *>(node);
+				const auto master = std::move(child->master);
+				auto &state = *static_cast<bounded_state *>(master.get());
+				const auto slot = static_cast<size_t>(child - state.nodes.data());
+				try
+				{
+					if constexpr (std::same_as<results_t, no_result>)
+					{
+						get_ready_result(*state.tasks[slot]);
+						state.finished(slot, child->index);
+					}
+					else
+						state.finished(slot, child->index, get_ready_result(*state.tasks[slot]));
+				}
+				catch (...)
+				{
+					state.finished_exception(slot);
+				}
+			}
+
+			// Resumes the driver when fewer than limit children are in flight
+			struct wait_awaiter
+			{
+				bounded_state &state;
+				size_t limit;
+
+				static bool await_ready() noexcept
+				{
+					return false;
+				}
+
+				bool await_suspend(std::coroutine_handle<> handle) noexcept
+				{
+					std::scoped_lock l{ state.lock };
+					if (state.in_flight < limit)
+						return false;
+					state.waiting = handle;
+					state.waiting_limit = limit;
+					return true;
+				}
+
+				static void await_resume() noexcept
+				{
+				}
+			};
+
+			wait_awaiter wait_slot() noexcept
+			{
+				return { *this, max_in_flight };
+			}
+
+			wait_awaiter wait_all() noexcept
+			{
+				return { *this, 1 };
+			}
+
+			static void launch(const std::shared_ptr<bounded_state> &state, Awaitable &&task);
+		};
+
+		template<class State, class Awaitable>
+		inline fire_and_forget<> bounded_helper_single(std::shared_ptr<State> state, Awaitable task, size_t index) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<typename State::results_t, no_result>)
+				{
+					co_await task;
+					state->finished(State::no_slot, index);
+				}
+				else
+				{
+					state->finished(State::no_slot, index, co_await task);
+				}
+			}
+			catch (...)
+			{
+				state->finished_exception(State::no_slot);
+			}
+		}
+
+		// Must be called after wait_slot, when a slot is guaranteed to be free
+		template<class Awaitable>
+		inline void bounded_state<Awaitable>::launch(const std::shared_ptr<bounded_state> &state, Awaitable &&task)
+		{
+			size_t slot = no_slot;
+			size_t index;
+			{
+				std::scoped_lock l{ state->lock };
+				if constexpr (!std::same_as<results_t, no_result>)
+				{
+					if (state->started == state->results.size())
+						state->results.emplace_back();
+				}
+				if constexpr (node_awaitable<Awaitable>)
+				{
+					slot = state->free_slots.back();
+					state->free_slots.pop_back();
+				}
+				++state->in_flight;
+				index = state->started++;
+			}
+
+			if constexpr (node_awaitable<Awaitable>)
+			{
+				auto &stored = state->tasks[slot].emplace(std::move(task));
+				auto &node = state->nodes[slot];
+				node.on_complete = &complete;
+				node.master = state;
+				node.index = index;
+				if (!stored.set_node(node))
+					complete(&node);
+			}
+			else
+				bounded_helper_single(state, std::move(task), index);
+		}
+
+		template<class Awaitable>
+		inline auto bounded_result(const std::shared_ptr<bounded_state<Awaitable>> &state)
+		{
+			if (state->exception)
+				std::rethrow_exception(state->exception);
+			if constexpr (!std::same_as<typename bounded_state<Awaitable>::results_t, no_result>)
+			{
+				state->results.resize(state->started);
+				return std::move(state->results);
+			}
+		}
+
+		template<class Awaitable>
+		using bounded_future_t = future<std::conditional_t<std::same_as<bounded_results_t<Awaitable>, no_result>, void, bounded_results_t<Awaitable>>>;
+
+		template<class Range, class Awaitable = bounded_child_t<sr::range_reference_t<Range>>>
+		inline bounded_future_t<Awaitable> when_all_bounded_impl(Range range, size_t max_in_flight)
+		{
+			using state_t = bounded_state<Awaitable>;
+			const auto state = std::make_shared<state_t>(max_in_flight);
+			if constexpr (sr::sized_range<Range> && !std::same_as<typename state_t::results_t, no_result>)
+				state->results.resize(sr::size(range));
+
+			try
+			{
+				for (auto &&item : range)
+				{
+					co_await state->wait_slot();
+					if (state->failed())
+						break;
+					state_t::launch(state, make_bounded_child(std::forward<decltype(item)>(item)));
+				}
+			}
+			catch (...)
+			{
+				state->set_exception(std::current_exception());
+			}
+
+			co_await state->wait_all();
+			co_return bounded_result(state);
+		}
+
+		template<class Item, class Awaitable = bounded_child_t<Item>>
+		inline bounded_future_t<Awaitable> when_all_bounded_impl(async_generator<Item> generator, size_t max_in_flight)
+		{
+			using state_t = bounded_state<Awaitable>;
+			const auto state = std::make_shared<state_t>(max_in_flight);
+
+			try
+			{
+				for (auto it = co_await generator.begin(); it != generator.end(); it = co_await ++it)
+				{
+					co_await state->wait_slot();
+					if (state->failed())
+						break;
+					state_t::launch(state, make_bounded_child(*it));
+				}
+			}
+			catch (...)
+			{
+				state->set_exception(std::current_exception());
+			}
+
+			co_await state->wait_all();
+			co_return bounded_result(state);
+		}
+
+		// Starts at most max_in_flight operations at once, the next one is started when one of them completes.
+		// Range (or generator) is traversed lazily and only once. Its items are callables that return awaitables
+		// or lazy awaitables themselves. Results are stored in the order of items. After the first exception no new
+		// operations are started, the exception is rethrown when the started ones complete
+		template<sr::input_range Range>
+		inline auto when_all_bounded(Range &&range, size_t max_in_flight)
+		{
+			return when_all_bounded_impl(rv::all(std::forward<Range>(range)), max_in_flight);
+		}
+
+		template<class Item>
+		inline auto when_all_bounded(async_generator<Item> &&generator, size_t max_in_flight)
+		{
+			return when_all_bounded_impl(std::move(generator), max_in_flight);
+		}
+	}
+
+	using details::when_all_bounded;
+}
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "impl/when_all_when_any_base.h"
+#include "cancel.h"
 
 namespace corsl
 {
@@ -24,13 +25,21 @@ namespace corsl
 			Result result;
 			std::exception_ptr exception;
 			size_t index;
+			void (*cancel_losers)(when_any_block *block) noexcept {};	// set if losers are cancelled
+
+			void won(std::coroutine_handle<> continuation) noexcept
+			{
+				if (cancel_losers)
+					cancel_losers(this);
+				continuation();
+			}
 
 			void finished_exception() noexcept
 			{
 				if (auto continuation = resume.exchange(nullptr, std::memory_order_relaxed))
 				{
 					exception = std::current_exception();
-					continuation();
+					won(continuation);
 				}
 			}
 
@@ -39,7 +48,7 @@ namespace corsl
 				if (auto continuation = resume.exchange(nullptr, std::memory_order_relaxed))
 				{
 					index = index_;
-					continuation();
+					won(continuation);
 				}
 			}
 
@@ -50,7 +59,7 @@ namespace corsl
 				{
 					result = std::forward<V>(result_);
 					index = index_;
-					continuation();
+					won(continuation);
 				}
 			}
 		};
@@ -76,26 +85,104 @@ namespace corsl
 			}
 		}
 
-		template<class T, size_t N, class Tuple, size_t...I>
-		inline void when_any_helper(std::array<std::shared_ptr<when_any_block<T>>, N> &&master, Tuple &&tuple, std::index_sequence<I...>) noexcept
+		// Shared block that also owns the children, so losers may complete after the awaiting coroutine has resumed
+		template<class T, class Tasks, class Nodes>
+		struct when_any_state : when_any_block<T>
+		{
+			Tasks tasks;
+			Nodes nodes;
+			std::optional<cancellation_source> source;
+
+			template<class...Args>
+			when_any_state(Args &&...args) :
+				tasks(std::forward<Args>(args)...)
+			{}
+
+			static void cancel_all(when_any_block<T> *block) noexcept
+			{
+				auto &state = static_cast<when_any_state &>(*block);
+				state.source->cancel();
+				cancel_children(state.tasks);
+			}
+
+			// Once the first child completes, the source and the remaining children are cancelled
+			void link(const cancellation_source &source_)
+			{
+				source = source_;
+				this->cancel_losers = &cancel_all;
+			}
+		};
+
+		template<class State, class Awaitable>
+		inline void when_any_deliver(State &state, Awaitable &task, size_t index) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<result_type<void>, get_result_type_t<Awaitable>>)
+				{
+					get_ready_result(task);
+					state.finished(index);
+				}
+				else
+				{
+					state.finished(get_ready_result(task), index);
+				}
+			}
+			catch (...)
+			{
+				state.finished_exception();
+			}
+		}
+
+		// Returns false if the child has already completed, the node must be run by the caller then
+		template<class Awaitable>
+		inline bool when_any_set_node(Awaitable &task, shared_child_node &node, std::shared_ptr<void> master, size_t index) noexcept
+		{
+			node.master = std::move(master);
+			node.index = index;
+			return task.set_node(node);
+		}
+
+		// Library awaitables get completion nodes, other awaitables are moved to helper coroutines
+		template<class T, size_t Index, class State>
+		inline void when_any_start_single(const std::shared_ptr<State> &state) noexcept
+		{
+			auto &task = std::get<Index>(state->tasks);
+			if constexpr (node_awaitable<std::decay_t<decltype(task)>>)
+			{
+				auto &node = state->nodes[Index];
+				node.on_complete = [](completion_node *node) noexcept
+				{
+					const auto master = std::move(static_cast<shared_child_node *>(node)->master);
+					auto &state = *static_cast<State *>(master.get());
+					when_any_deliver(state, std::get<Index>(state.tasks), Index);
+				};
+				if (!when_any_set_node(task, node, state, Index))
+					node.on_complete(&node);
+			}
+			else
+				when_any_helper_single<T>(state, std::move(task), Index);
+		}
+
+		template<class T, class State, size_t...I>
+		inline void when_any_helper(const std::shared_ptr<State> &state, std::index_sequence<I...>) noexcept
 		{
-			(..., when_any_helper_single<T>(std::get<I>(std::move(master)), std::get<I>(std::move(tuple)), I));
+			(..., when_any_start_single<T, I>(state));
 		}
 
 		template<class Result, class... Awaitables>
 		struct when_any_awaitable
 		{
-			using any_block_t = when_any_block<Result>;
 			static constexpr size_t N = sizeof...(Awaitables);
 			static constexpr bool is_void = std::same_as<Result, no_result>;
+			using state_t = when_any_state<Result, std::tuple<std::decay_t<Awaitables>...>, std::array<shared_child_node, N>>;
 
-			std::shared_ptr<any_block_t> ptr{ std::make_shared<any_block_t>() };
-			std::tuple<std::decay_t<Awaitables>...> awaitables;
+			std::shared_ptr<state_t> ptr;
 
 			// If you see the compilation error on the constructor, check if you are trying to pass corsl::future as NOT an rvalue
 			template<class...Args>
-			when_any_awaitable(Args &&...args) noexcept :
-				awaitables{ std::forward<Args>(args)... }
+			when_any_awaitable(Args &&...args) :
+				ptr{ std::make_shared<state_t>(std::forward<Args>(args)...) }
 			{}
 
 			bool await_ready() const noexcept
@@ -105,13 +192,10 @@ namespace corsl
 
 			void await_suspend(std::coroutine_handle<> handle)
 			{
-				ptr->resume.store(handle, std::memory_order_relaxed);
-				std::array<std::shared_ptr<any_block_t>, N> references;
-				std::fill(references.begin(), references.end(), ptr);
-
-				auto awaitables_copy = std::move(awaitables);
-				using index_t = std::make_index_sequence<N>;
-				when_any_helper(std::move(references), std::move(awaitables_copy), index_t{});
+				// the awaiting coroutine may be resumed and destroy this object before all children are started
+				const auto state = ptr;
+				state->resume.store(handle, std::memory_order_relaxed);
+				when_any_helper<Result>(state, std::make_index_sequence<N>{});
 			}
 
 			size_t iresume() const requires is_void
@@ -143,7 +227,7 @@ namespace corsl
 		using safe_invoke_result = std::conditional_t<std::same_as<T, result_type<void>>, no_result, invoke_result<T>>;
 
 		template<class...Awaitables>
-		inline auto when_any(Awaitables &&...awaitables)
+		inline auto when_any(Awaitables &&...awaitables) requires (!std::same_as<std::remove_cvref_t<Awaitables>, cancellation_source> && ...)
 		{
 			static_assert(sizeof...(Awaitables) >= 2, "when_any must be passed at least two arguments");
 
@@ -165,43 +249,73 @@ namespace corsl
 			}
 		}
 
+		// Cancels the source and the losing futures as soon as the first task completes
+		template<class...Awaitables>
+		inline auto when_any(const cancellation_source &source, Awaitables &&...awaitables)
+		{
+			auto result = when_any(std::forward<Awaitables>(awaitables)...);
+			result.ptr->link(source);
+			return result;
+		}
+
 		// range
 		template<class Result, class Awaitable>
 		struct when_any_awaitable_range
 		{
 			static constexpr const bool is_void = std::same_as<Result, result_type<void>>;
 			static constexpr const bool is_copyable = std::copyable<Awaitable>;
-			using when_any_block = when_any_block<safe_invoke_result<Result>>;
+			static constexpr const bool is_node_awaitable = node_awaitable<Awaitable>;
+			using value_type = safe_invoke_result<Result>;
+			using state_t = when_any_state<value_type, std::vector<Awaitable>, std::vector<shared_child_node>>;
 			using T = invoke_result<Result>;
 
-			std::shared_ptr<when_any_block> ptr{ std::make_shared<when_any_block>() };
-			std::vector<Awaitable> awaitables;
+			std::shared_ptr<state_t> ptr;
 
 			template<class Range>
 			when_any_awaitable_range(Range &&range) requires !is_copyable :
-				awaitables{ std::make_move_iterator(sr::begin(range)), std::make_move_iterator(sr::end(range)) }
+				ptr{ std::make_shared<state_t>(std::make_move_iterator(sr::begin(range)), std::make_move_iterator(sr::end(range))) }
 			{
+				if constexpr (is_node_awaitable)
+					ptr->nodes.resize(ptr->tasks.size());
 			}
 
 			template<class Range>
 			when_any_awaitable_range(Range &&range) requires is_copyable :
-				awaitables{ sr::begin(range), sr::end(range) }
+				ptr{ std::make_shared<state_t>(sr::begin(range), sr::end(range)) }
 			{
+				if constexpr (is_node_awaitable)
+					ptr->nodes.resize(ptr->tasks.size());
 			}
 
 			bool await_ready() const noexcept
 			{
-				return awaitables.empty();
+				return ptr->tasks.empty();
 			}
 
 			void await_suspend(std::coroutine_handle<> handle)
 			{
-				ptr->resume.store(handle, std::memory_order_relaxed);
-				std::vector<std::shared_ptr<when_any_block>> references(awaitables.size(), ptr);
-
-				auto awaitables_local_copy = std::move(awaitables);
-				for (size_t i = 0; i < references.size(); ++i)
-					when_any_helper_single(std::move(references[i]), std::move(awaitables_local_copy[i]), i);
+				// the awaiting coroutine may be resumed and destroy this object before all children are started
+				const auto state = ptr;
+				state->resume.store(handle, std::memory_order_relaxed);
+				auto &tasks = state->tasks;
+				for (size_t i = 0; i < tasks.size(); ++i)
+				{
+					if constexpr (is_node_awaitable)
+					{
+						auto &node = state->nodes[i];
+						node.on_complete = [](completion_node *node) noexcept
+						{
+							const auto child = static_cast<shared_child_node *>(node);
+							const auto master = std::move(child->master);
+							auto &state = *static_cast<state_t *>(master.get());
+							when_any_deliver(state, state.tasks[child->index], child->index);
+						};
+						if (!when_any_set_node(tasks[i], node, state, i))
+							node.on_complete(&node);
+					}
+					else
+						when_any_helper_single<value_type>(state, std::move(tasks[i]), i);
+				}
 			}
 
 			size_t await_resume() const requires is_void
@@ -235,6 +349,14 @@ namespace corsl
 			using future_type = sr::range_value_t<Range>;
 			return range_when_any_impl(get_result_type_t<future_type>{}, std::move(range));
 		}
+
+		template<sr::range Range>
+		inline auto when_any_range(const cancellation_source &source, Range &&range)
+		{
+			auto result = when_any_range(std::forward<Range>(range));
+			result.ptr->link(source);
+			return result;
+		}
 	}
 
 	using details::when_any;
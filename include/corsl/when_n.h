@@ -0,0 +1,342 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "when_all.h"
+#include "cancel.h"
+
+namespace corsl
+{
+	namespace details
+	{
+		///////////////////////////////////
+		// when_n
+		template<class Value>
+		using when_n_result_t = std::conditional_t<std::same_as<Value, no_result>, std::vector<size_t>, std::vector<std::pair<size_t, Value>>>;
+
+		// Single heap block with intrusive reference counting: the awaitable holds one reference and every started
+		// child holds another one, so children do not copy a shared_ptr and may complete after the awaiting coroutine
+		// has resumed
+		template<class Value, class Tasks, class Nodes>
+		struct when_n_state
+		{
+			std::atomic<std::coroutine_handle<>> resume{};	// taken by the k-th successful child or by the failure that makes quorum unreachable
+			std::atomic<int> counter;	// successes left to store, plus one held by await_suspend
+			std::atomic<size_t> succeeded{};	// claims result slots
+			std::atomic<size_t> failed{};
+			std::atomic<size_t> refs{ 1 };
+			const size_t k;
+			size_t max_failures;
+			std::exception_ptr exception;
+			when_n_result_t<Value> results;
+			Tasks tasks;
+			Nodes nodes;
+			std::optional<cancellation_source> source;
+
+			template<class...Args>
+			when_n_state(size_t k_, Args &&...args) :
+				k{ k_ },
+				tasks(std::forward<Args>(args)...)
+			{
+				size_t size;
+				if constexpr (sr::range<Tasks>)
+					size = tasks.size();
+				else
+					size = std::tuple_size_v<Tasks>;
+
+				if (k > size) [[unlikely]]
+					throw hresult_error{ E_INVALIDARG };
+
+				max_failures = size - k;
+				counter.store(static_cast<int>(k) + 1, std::memory_order_relaxed);
+				results.resize(k);
+			}
+
+			void release() noexcept
+			{
+				if (1 == refs.fetch_sub(1, std::memory_order_acq_rel))
+					delete this;
+			}
+
+			void cancel_losers() noexcept
+			{
+				if (source)
+				{
+					source->cancel();
+					cancel_children(tasks);
+				}
+			}
+
+			void check_resume() noexcept
+			{
+				if (1 == counter.fetch_sub(1, std::memory_order_acq_rel))
+				{
+					if (auto continuation = resume.exchange(nullptr, std::memory_order_acquire))
+					{
+						cancel_losers();
+						continuation();
+					}
+				}
+			}
+
+			// Returns false if the awaiting coroutine should not suspend
+			bool started() noexcept
+			{
+				if (1 == counter.fetch_sub(1, std::memory_order_acq_rel) && resume.exchange(nullptr, std::memory_order_acquire))
+				{
+					cancel_losers();
+					return false;
+				}
+				return true;
+			}
+
+			void finished_exception() noexcept
+			{
+				if (failed.fetch_add(1, std::memory_order_relaxed) == max_failures)
+				{
+					if (auto continuation = resume.exchange(nullptr, std::memory_order_acq_rel))
+					{
+						exception = std::current_exception();
+						cancel_losers();
+						continuation();
+					}
+				}
+			}
+
+			// Successes after the k-th one are dropped
+			void finished(size_t index) noexcept
+			{
+				if (const auto slot = succeeded.fetch_add(1, std::memory_order_relaxed); slot < k)
+				{
+					results[slot] = index;
+					check_resume();
+				}
+			}
+
+			template<class V>
+			void finished(size_t index, V &&value) noexcept
+			{
+				if (const auto slot = succeeded.fetch_add(1, std::memory_order_relaxed); slot < k)
+				{
+					results[slot] = { index, std::forward<V>(value) };
+					check_resume();
+				}
+			}
+		};
+
+		template<class State, class Awaitable>
+		inline fire_and_forget<> when_n_helper_single(State *state, Awaitable task, size_t index) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<result_type<void>, get_result_type_t<Awaitable>>)
+				{
+					co_await task;
+					state->finished(index);
+				}
+				else
+				{
+					state->finished(index, co_await task);
+				}
+			}
+			catch (...)
+			{
+				state->finished_exception();
+			}
+			state->release();
+		}
+
+		template<class State, class Awaitable>
+		inline void when_n_deliver(State &state, Awaitable &task, size_t index) noexcept
+		{
+			try
+			{
+				if constexpr (std::same_as<result_type<void>, get_result_type_t<Awaitable>>)
+				{
+					get_ready_result(task);
+					state.finished(index);
+				}
+				else
+				{
+					state.finished(index, get_ready_result(task));
+				}
+			}
+			catch (...)
+			{
+				state.finished_exception();
+			}
+		}
+
+		template<class State, class Index>
+		inline void when_n_start_single(State *state, Index index) noexcept
+		{
+			auto &task = get_task(state->tasks, index);
+			if constexpr (node_awaitable<std::remove_reference_t<decltype(task)>>)
+			{
+				auto &node = state->nodes[index];
+				node.on_complete = [](completion_node *node) noexcept
+				{
+					const auto child = static_cast<child_node *>(node);
+					auto &state = *static_cast<State *>(child->master);
+					if constexpr (std::same_as<Index, size_t>)
+						when_n_deliver(state, state.tasks[child->index], child->index);
+					else
+						when_n_deliver(state, get_task(state.tasks, Index{}), Index::value);
+					state.release();
+				};
+				node.master = state;
+				node.index = index;
+				if (!task.set_node(node))
+					node.on_complete(&node);
+			}
+			else
+				when_n_helper_single(state, std::move(task), static_cast<size_t>(index));
+		}
+
+		template<class State>
+		struct when_n_awaitable_base
+		{
+			struct releaser
+			{
+				void operator()(State *state) const noexcept
+				{
+					state->release();
+				}
+			};
+
+			std::unique_ptr<State, releaser> ptr;
+
+			bool await_ready() const noexcept
+			{
+				return !ptr->k;
+			}
+
+			void link(const cancellation_source &source)
+			{
+				ptr->source = source;
+			}
+
+			// Results are in the order of completion
+			auto await_resume()
+			{
+				if (ptr->exception)
+					std::rethrow_exception(ptr->exception);
+				return std::move(ptr->results);
+			}
+
+		protected:
+			// Starts children with start(state), holding an extra reference while they are being started
+			template<class F>
+			bool suspend(std::coroutine_handle<> handle, size_t count, F &&start) noexcept
+			{
+				// the awaiting coroutine may be resumed and destroy this object before all children are started
+				const auto state = ptr.get();
+				state->refs.fetch_add(count + 1, std::memory_order_relaxed);
+				state->resume.store(handle, std::memory_order_relaxed);
+				start(state);
+				const auto result = state->started();
+				state->release();
+				return result;
+			}
+		};
+
+		template<class Value, class...Awaitables>
+		struct when_n_awaitable : when_n_awaitable_base<when_n_state<Value, std::tuple<std::decay_t<Awaitables>...>, std::array<child_node, sizeof...(Awaitables)>>>
+		{
+			static constexpr size_t N = sizeof...(Awaitables);
+			using state_t = when_n_state<Value, std::tuple<std::decay_t<Awaitables>...>, std::array<child_node, N>>;
+
+			// If you see the compilation error on the constructor, check if you are trying to pass corsl::future as NOT an rvalue
+			template<class...Args>
+			when_n_awaitable(size_t k, Args &&...args)
+			{
+				this->ptr.reset(new state_t(k, std::forward<Args>(args)...));
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				return this->suspend(handle, N, [](state_t *state) noexcept
+				{
+					[&]<size_t...I>(std::index_sequence<I...>)
+					{
+						(..., when_n_start_single(state, std::integral_constant<size_t, I>{}));
+					}(std::make_index_sequence<N>{});
+				});
+			}
+		};
+
+		template<class Value, class Awaitable>
+		struct when_n_awaitable_range : when_n_awaitable_base<when_n_state<Value, std::vector<Awaitable>, std::vector<child_node>>>
+		{
+			using state_t = when_n_state<Value, std::vector<Awaitable>, std::vector<child_node>>;
+
+			template<sr::range Range>
+			when_n_awaitable_range(size_t k, Range &&range)
+			{
+				if constexpr (std::copyable<Awaitable>)
+					this->ptr.reset(new state_t(k, sr::begin(range), sr::end(range)));
+				else
+					this->ptr.reset(new state_t(k, std::make_move_iterator(sr::begin(range)), std::make_move_iterator(sr::end(range))));
+
+				if constexpr (node_awaitable<Awaitable>)
+					this->ptr->nodes.resize(this->ptr->tasks.size());
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				return this->suspend(handle, this->ptr->tasks.size(), [](state_t *state) noexcept
+				{
+					for (size_t i = 0; i < state->tasks.size(); ++i)
+						when_n_start_single(state, i);
+				});
+			}
+		};
+
+		// Resumes when k of the tasks have succeeded or when so many of them have failed that k successes are no
+		// longer possible. Produces std::vector<std::pair<size_t, T>> of k indices and results in the order of
+		// completion (std::vector<size_t> of indices for void tasks) or rethrows the exception of the failure that
+		// made the quorum unreachable. Throws hresult_error(E_INVALIDARG) if k is greater than the number of tasks
+		template<class...Awaitables>
+		inline auto when_n(size_t k, Awaitables &&...awaitables)
+		{
+			static_assert(sizeof...(Awaitables) >= 1, "when_n must be passed at least one task");
+			static_assert(mp11::mp_apply<mp11::mp_same, mp11::mp_list<get_result_type_t<Awaitables>...>>::value, "when_n tasks must have the same result type");
+
+			using value_t = fail_fast_result_t<get_result_type_t<mp11::mp_first<mp11::mp_list<Awaitables...>>>>;
+			return when_n_awaitable<value_t, Awaitables...>{ k, std::forward<Awaitables>(awaitables)... };
+		}
+
+		// The source and the remaining futures are cancelled as soon as the awaiting coroutine is resumed
+		template<class...Awaitables>
+		inline auto when_n(const cancellation_source &source, size_t k, Awaitables &&...awaitables)
+		{
+			auto result = when_n(k, std::forward<Awaitables>(awaitables)...);
+			result.link(source);
+			return result;
+		}
+
+		template<sr::range Range>
+		inline auto when_n_range(size_t k, Range &&range)
+		{
+			using future_type = std::decay_t<sr::range_value_t<Range>>;
+			return when_n_awaitable_range<fail_fast_result_t<get_result_type_t<future_type>>, future_type>{ k, std::forward<Range>(range) };
+		}
+
+		template<sr::range Range>
+		inline auto when_n_range(const cancellation_source &source, size_t k, Range &&range)
+		{
+			auto result = when_n_range(k, std::forward<Range>(range));
+			result.link(source);
+			return result;
+		}
+	}
+
+	using details::when_n;
+	using details::when_n_range;
+}
@@ -0,0 +1,445 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+// This header intentionally depends on the Standard Library only, so the scheduler may be used on
+// platforms that do not have Windows Thread Pool
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace corsl
+{
+	namespace details
+	{
+		// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models")
+		// The owner thread pushes and pops at the bottom, other threads steal from the top
+		class chase_lev_deque
+		{
+			struct ring
+			{
+				const int64_t capacity;	// always a power of 2
+				std::unique_ptr<std::atomic<void *>[]> items;
+
+				explicit ring(int64_t capacity) :
+					capacity{ capacity },
+					items{ new std::atomic<void *>[static_cast<size_t>(capacity)] }
+				{}
+
+				void *get(int64_t index) const noexcept
+				{
+					return items[static_cast<size_t>(index & (capacity - 1))].load(std::memory_order_relaxed);
+				}
+
+				void put(int64_t index, void *item) noexcept
+				{
+					items[static_cast<size_t>(index & (capacity - 1))].store(item, std::memory_order_relaxed);
+				}
+
+				std::unique_ptr<ring> grow(int64_t bottom, int64_t top) const
+				{
+					auto result = std::make_unique<ring>(capacity * 2);
+					for (auto i = top; i != bottom; ++i)
+						result->put(i, get(i));
+					return result;
+				}
+			};
+
+			alignas(64) std::atomic<int64_t> top{ 0 };
+			alignas(64) std::atomic<int64_t> bottom{ 0 };
+			std::atomic<ring *> array;
+			// Rings are never freed while deque is alive, because a thief may still be reading the previous one
+			std::vector<std::unique_ptr<ring>> rings;
+
+		public:
+			explicit chase_lev_deque(int64_t initial_capacity = 256)
+			{
+				rings.push_back(std::make_unique<ring>(initial_capacity));
+				array.store(rings.back().get(), std::memory_order_relaxed);
+			}
+
+			chase_lev_deque(const chase_lev_deque &) = delete;
+			chase_lev_deque &operator =(const chase_lev_deque &) = delete;
+
+			// Owner thread only
+			void push(void *item)
+			{
+				const auto b = bottom.load(std::memory_order_relaxed);
+				const auto t = top.load(std::memory_order_acquire);
+				auto a = array.load(std::memory_order_relaxed);
+				if (b - t > a->capacity - 1) [[unlikely]]
+				{
+					rings.push_back(a->grow(b, t));
+					a = rings.back().get();
+					array.store(a, std::memory_order_release);
+				}
+				a->put(b, item);
+				std::atomic_thread_fence(std::memory_order_release);
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+
+			// Owner thread only
+			void *pop() noexcept
+			{
+				const auto b = bottom.load(std::memory_order_relaxed) - 1;
+				const auto a = array.load(std::memory_order_relaxed);
+				bottom.store(b, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				auto t = top.load(std::memory_order_relaxed);
+
+				if (t > b)
+				{
+					// deque is empty
+					bottom.store(b + 1, std::memory_order_relaxed);
+					return nullptr;
+				}
+
+				auto item = a->get(b);
+				if (t == b)
+				{
+					// last item, race against thieves
+					if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+						item = nullptr;
+					bottom.store(b + 1, std::memory_order_relaxed);
+				}
+				return item;
+			}
+
+			// Any thread
+			void *steal() noexcept
+			{
+				auto t = top.load(std::memory_order_acquire);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				const auto b = bottom.load(std::memory_order_acquire);
+
+				if (t < b)
+				{
+					const auto a = array.load(std::memory_order_acquire);
+					auto item = a->get(t);
+					if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+						return item;
+				}
+				return nullptr;
+			}
+
+			bool empty() const noexcept
+			{
+				return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+			}
+		};
+
+		class work_stealing_pool;
+
+		// Executor handle for work_stealing_pool, default-constructed executor targets the default pool
+		struct work_stealing_executor
+		{
+			work_stealing_pool *pool{};
+
+			void schedule(std::coroutine_handle<> handle) const;
+			void schedule_bulk(std::span<const std::coroutine_handle<>> handles) const;
+		};
+
+		// Portable work-stealing scheduler
+		// Each worker owns a Chase-Lev deque. Work submitted from a worker thread goes to its own deque, work
+		// submitted from other threads goes to a shared injection queue. Idle workers steal from each other and
+		// park on an atomic epoch counter (futex on Linux, WaitOnAddress on Windows) when there is nothing to do.
+		class work_stealing_pool
+		{
+			struct worker
+			{
+				chase_lev_deque deque;
+				std::thread thread;
+			};
+
+			struct worker_context
+			{
+				work_stealing_pool *pool;
+				worker *self;
+			};
+
+			inline static thread_local worker_context current{};
+
+			static constexpr unsigned spin_rounds = 4;
+			static constexpr size_t injection_batch = 32;
+
+			std::vector<std::unique_ptr<worker>> workers;
+
+			std::mutex injection_lock;
+			std::deque<void *> injection;
+			std::atomic<size_t> injection_size{ 0 };
+
+			alignas(64) std::atomic<uint32_t> wake_epoch{ 0 };
+			alignas(64) std::atomic<uint32_t> sleepers{ 0 };
+			std::atomic<bool> stopping{ false };
+
+			static void run_item(void *item) noexcept
+			{
+				std::coroutine_handle<>::from_address(item)();
+			}
+
+			void wake_one() noexcept
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (sleepers.load(std::memory_order_relaxed)) [[unlikely]]
+				{
+					wake_epoch.fetch_add(1, std::memory_order_release);
+					wake_epoch.notify_one();
+				}
+			}
+
+			void wake_many(size_t count) noexcept
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				const auto idle = sleepers.load(std::memory_order_relaxed);
+				if (idle) [[unlikely]]
+				{
+					wake_epoch.fetch_add(1, std::memory_order_release);
+					if (count >= idle)
+						wake_epoch.notify_all();
+					else
+						while (count--)
+							wake_epoch.notify_one();
+				}
+			}
+
+			void wake_all() noexcept
+			{
+				wake_epoch.fetch_add(1, std::memory_order_release);
+				wake_epoch.notify_all();
+			}
+
+			// Take one item from the injection queue and move a batch of others to our deque, so they can be stolen
+			void *take_injected(worker &self)
+			{
+				if (!injection_size.load(std::memory_order_relaxed))
+					return nullptr;
+
+				std::unique_lock l{ injection_lock, std::try_to_lock };
+				if (!l.owns_lock() || injection.empty())
+					return nullptr;
+
+				auto item = injection.front();
+				injection.pop_front();
+
+				size_t count = 1;
+				const auto extra = std::min(injection.size() / workers.size(), injection_batch);
+				for (size_t i = 0; i < extra; ++i, ++count)
+				{
+					self.deque.push(injection.front());
+					injection.pop_front();
+				}
+				injection_size.fetch_sub(count, std::memory_order_relaxed);
+				l.unlock();
+
+				if (extra)
+					wake_one();
+				return item;
+			}
+
+			void *steal(const worker &self, uint32_t &seed) noexcept
+			{
+				// xorshift32 gives us a random starting victim
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+
+				const auto count = workers.size();
+				const auto start = seed % count;
+				for (size_t i = 0; i < count; ++i)
+				{
+					auto &victim = *workers[(start + i) % count];
+					if (&victim != &self)
+						if (auto item = victim.deque.steal())
+							return item;
+				}
+				return nullptr;
+			}
+
+			void *find_work(worker &self, uint32_t &seed)
+			{
+				if (auto item = self.deque.pop())
+					return item;
+				if (auto item = take_injected(self))
+					return item;
+				return steal(self, seed);
+			}
+
+			bool has_work() const noexcept
+			{
+				if (injection_size.load(std::memory_order_relaxed))
+					return true;
+				for (const auto &w : workers)
+					if (!w->deque.empty())
+						return true;
+				return false;
+			}
+
+			void run(worker &self, uint32_t seed)
+			{
+				current = { this, &self };
+
+				for (;;)
+				{
+					void *item{};
+					for (unsigned round = 0; !item && round < spin_rounds; ++round)
+					{
+						item = find_work(self, seed);
+						if (!item && round)
+							std::this_thread::yield();
+					}
+
+					if (item)
+					{
+						run_item(item);
+						continue;
+					}
+
+					// Nothing to do, park
+					const auto epoch = wake_epoch.load(std::memory_order_acquire);
+					sleepers.fetch_add(1, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+
+					if (has_work())
+					{
+						sleepers.fetch_sub(1, std::memory_order_relaxed);
+						continue;
+					}
+
+					if (stopping.load(std::memory_order_acquire))
+					{
+						sleepers.fetch_sub(1, std::memory_order_relaxed);
+						break;
+					}
+
+					wake_epoch.wait(epoch, std::memory_order_acquire);
+					sleepers.fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				current = {};
+			}
+
+		public:
+			explicit work_stealing_pool(unsigned threads = std::thread::hardware_concurrency())
+			{
+				threads = std::max(threads, 1u);
+				workers.reserve(threads);
+				for (unsigned i = 0; i < threads; ++i)
+					workers.push_back(std::make_unique<worker>());
+
+				try
+				{
+					for (unsigned i = 0; i < threads; ++i)
+						workers[i]->thread = std::thread{ [this, i] { run(*workers[i], 0x9E3779B9u * (i + 1)); } };
+				}
+				catch (...)
+				{
+					shutdown();
+					throw;
+				}
+			}
+
+			// Pending work is completed before destructor returns. Submitting new work from non-pool threads
+			// concurrently with destruction is not allowed
+			~work_stealing_pool()
+			{
+				shutdown();
+			}
+
+			work_stealing_pool(const work_stealing_pool &) = delete;
+			work_stealing_pool &operator =(const work_stealing_pool &) = delete;
+
+			// Process-wide pool with one worker per hardware thread
+			static work_stealing_pool &get_default()
+			{
+				static work_stealing_pool pool;
+				return pool;
+			}
+
+			void schedule(std::coroutine_handle<> handle)
+			{
+				if (current.pool == this)
+					current.self->deque.push(handle.address());
+				else
+				{
+					std::scoped_lock l{ injection_lock };
+					injection.push_back(handle.address());
+					injection_size.fetch_add(1, std::memory_order_relaxed);
+				}
+				wake_one();
+			}
+
+			// Pushes a whole batch under a single lock (or into the worker's own deque, from where it is stolen by
+			// other workers) and wakes as many parked workers as needed
+			void schedule_bulk(std::span<const std::coroutine_handle<>> handles)
+			{
+				if (handles.empty())
+					return;
+
+				if (current.pool == this)
+					for (auto handle : handles)
+						current.self->deque.push(handle.address());
+				else
+				{
+					std::scoped_lock l{ injection_lock };
+					for (auto handle : handles)
+						injection.push_back(handle.address());
+					injection_size.fetch_add(handles.size(), std::memory_order_relaxed);
+				}
+				wake_many(std::min(handles.size(), workers.size()));
+			}
+
+			work_stealing_executor get_executor() noexcept
+			{
+				return { this };
+			}
+
+			size_t size() const noexcept
+			{
+				return workers.size();
+			}
+
+			// Returns true if called on one of this pool's worker threads
+			bool is_current() const noexcept
+			{
+				return current.pool == this;
+			}
+
+		private:
+			void shutdown() noexcept
+			{
+				stopping.store(true, std::memory_order_release);
+				wake_all();
+				for (auto &w : workers)
+					if (w->thread.joinable())
+						w->thread.join();
+			}
+		};
+
+		inline void work_stealing_executor::schedule(std::coroutine_handle<> handle) const
+		{
+			(pool ? *pool : work_stealing_pool::get_default()).schedule(handle);
+		}
+
+		inline void work_stealing_executor::schedule_bulk(std::span<const std::coroutine_handle<>> handles) const
+		{
+			(pool ? *pool : work_stealing_pool::get_default()).schedule_bulk(handles);
+		}
+	}
+
+	using details::work_stealing_pool;
+	using details::work_stealing_executor;
+}
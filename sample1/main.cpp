@@ -268,6 +268,45 @@ void test_shared_future()
 	CloseHandle(event);
 }
 
+// Hop-per-await microbenchmark: each chain moves to another pool thread on every iteration
+template<class Hop>
+corsl::future<void> hop_chain(const Hop &hop, int hops)
+{
+	for (int i = 0; i < hops; ++i)
+		co_await hop();
+}
+
+template<class Hop>
+void hop_benchmark(const wchar_t *name, const Hop &hop)
+{
+	const auto chains = std::max(std::thread::hardware_concurrency(), 1u) * 4;
+	constexpr int hops = 20000;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<corsl::future<void>> tasks;
+	tasks.reserve(chains);
+	for (unsigned i = 0; i < chains; ++i)
+		tasks.push_back(hop_chain(hop, hops));
+	corsl::block_wait(corsl::when_all_range(std::move(tasks)));
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(stop - start);
+	std::wcout << name << L": " << chains << L" chains, " << static_cast<double>(chains) * hops / seconds.count() << L" hops per second\n";
+}
+
+void scheduler_benchmark()
+{
+	std::wcout << L"Comparing schedulers on " << std::thread::hardware_concurrency() << L" hardware threads...\n";
+
+	// An explicit environment keeps the resumption on Windows thread pool even with CORSL_USE_WORK_STEALING_POOL
+	corsl::callback_environment env;
+	hop_benchmark(L"Windows thread pool", [&] { return corsl::resume_background(env); });
+	hop_benchmark(L"work_stealing_pool", [] { return corsl::resume_background(corsl::work_stealing_pool::get_default()); });
+}
+
+// Defined in stress.cpp
+void run_stress_tests();
+
 //corsl::async_generator<int> test_generator()
 //{
 //	using namespace corsl::timer;
@@ -303,6 +342,8 @@ int main()
 
 	sequential_test();
 	concurrent_test();
+	scheduler_benchmark();
+	run_stress_tests();
 
 	corsl::block_wait(
 		corsl::when_all(
@@ -0,0 +1,753 @@
+//-------------------------------------------------------------------------------------------------------
+// corsl - Coroutine Support Library
+// Copyright (C) 2017 - 2022 HHD Software Ltd.
+// Written by Alexander Bessonov
+//
+// Licensed under the MIT license. See LICENSE.txt file in the project root for full license information.
+//-------------------------------------------------------------------------------------------------------
+
+// Stress tests for the races between completion and consumption: every round runs producers and consumers on
+// different threads and verifies the results
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <corsl/all.h>
+#include <corsl/async_multi_queue.h>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	std::atomic<int> failures{ 0 };
+
+	void check(bool condition, const wchar_t *what)
+	{
+		if (!condition)
+		{
+			++failures;
+			std::wcout << L"  FAILED: " << what << L"\n";
+		}
+	}
+
+	// Waits for a condition that is met by detached coroutines
+	template<class F>
+	bool wait_until(const F &condition, std::chrono::milliseconds timeout = 5s)
+	{
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!condition())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(1ms);
+		}
+		return true;
+	}
+
+	// Counts destroyed coroutine frames
+	struct frame_counter
+	{
+		std::atomic<int> &counter;
+
+		~frame_counter()
+		{
+			++counter;
+		}
+	};
+
+	corsl::future<int> background_value(int value)
+	{
+		co_await corsl::resume_background();
+		co_return value;
+	}
+
+	corsl::future<int> counted_background_value(int value, std::atomic<int> &destroyed)
+	{
+		frame_counter counter{ destroyed };
+		co_await corsl::resume_background();
+		co_return value;
+	}
+
+	corsl::future<int> arena_value(std::allocator_arg_t, std::pmr::memory_resource *, int value)
+	{
+		co_await corsl::resume_background();
+		co_return value;
+	}
+
+	corsl::task<int> lazy_value(int value)
+	{
+		co_return co_await background_value(value);
+	}
+
+	corsl::future<int> loser(std::atomic<int> &cancelled)
+	{
+		try
+		{
+			co_await corsl::resume_background();
+			for (int i = 0; i < 10000; ++i)
+				co_await corsl::resume_after{ 1ms };
+		}
+		catch (const corsl::operation_cancelled &)
+		{
+			++cancelled;
+			throw;
+		}
+		co_return -1;
+	}
+
+	corsl::future<int> token_loser(const corsl::cancellation_source &source, std::atomic<int> &cancelled)
+	{
+		corsl::cancellation_token token{ co_await source };
+		co_await token.wait_cancelled();
+		++cancelled;
+		co_return -1;
+	}
+
+	// Suspends the coroutine and stores its handle
+	struct park_handle
+	{
+		std::vector<std::coroutine_handle<>> &handles;
+
+		static bool await_ready() noexcept
+		{
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			handles.push_back(handle);
+		}
+
+		static void await_resume() noexcept
+		{
+		}
+	};
+
+	// Tests for compatible_base.h and impl/frame_allocator.h
+
+	// Every coroutine of a bulk resumption runs exactly once, also when some of them block for a while
+	void test_bulk_resume()
+	{
+		constexpr int count = 10000;
+
+		for (int round = 0; round < 5; ++round)
+		{
+			std::vector<std::coroutine_handle<>> handles;
+			std::atomic<int> resumed{ 0 };
+			for (int i = 0; i < count; ++i)
+				[](park_handle park, std::atomic<int> &resumed, bool blocks) -> corsl::fire_and_forget
+				{
+					co_await park;
+					if (blocks)
+						std::this_thread::sleep_for(1ms);
+					++resumed;
+				}(park_handle{ handles }, resumed, i % 1000 == 0);
+
+			corsl::resume_on_background(std::span<const std::coroutine_handle<>>{ handles });
+			check(wait_until([&] { return resumed == count; }), L"bulk resumption resumes every coroutine");
+		}
+	}
+
+	// Coroutine frames are destroyed in batches on another thread, which returns them to the creating thread's cache
+	void test_frame_recycling()
+	{
+		constexpr int count = 5000;
+
+		std::atomic<int> destroyed{ 0 };
+		for (int round = 0; round < 10; ++round)
+		{
+			std::vector<std::coroutine_handle<>> handles;
+			for (int i = 0; i < count; ++i)
+				[](park_handle park, std::atomic<int> &destroyed) -> corsl::fire_and_forget
+				{
+					frame_counter counter{ destroyed };
+					co_await park;
+				}(park_handle{ handles }, destroyed);
+
+			std::thread{ [&]
+			{
+				for (auto handle : handles)
+					handle.destroy();
+			} }.join();
+		}
+		check(destroyed == count * 10, L"frames destroyed on another thread");
+	}
+
+	// Tests for future.h and promise.h
+
+	// Futures are dropped while other threads publish their results
+	void test_future_detach()
+	{
+		constexpr int rounds = 20000;
+
+		std::atomic<int> destroyed{ 0 };
+		for (int i = 0; i < rounds; ++i)
+			(void)counted_background_value(i, destroyed);
+		check(wait_until([&] { return destroyed == rounds; }), L"detached coroutine frames are destroyed");
+
+		std::vector<corsl::promise<int>> promises(rounds);
+		std::vector<corsl::future<int>> futures;
+		futures.reserve(rounds);
+		for (auto &promise : promises)
+			futures.push_back(promise.get_future());
+
+		std::thread setter{ [&]
+		{
+			for (int i = 0; i < rounds; ++i)
+				if (i % 2)
+					promises[i].set(i);
+				else
+					promises[i].set_inline(i);
+		} };
+		while (!futures.empty())
+			futures.pop_back();
+		setter.join();
+
+		// Continuations race with completion on the executor
+		long long sum = 0;
+		for (int i = 0; i < 1000; ++i)
+		{
+			corsl::promise<int> promise;
+			auto result = promise.get_future()
+				.then([](int v) { return v * 2; })
+				.then_on(corsl::thread_pool_executor<>{}, [](int v) { return v + 1; });
+			promise.set_on(corsl::thread_pool_executor<>{}, i);
+			sum += result.get();
+		}
+		check(sum == 1000LL * 999 + 1000, L"then and then_on chain");
+	}
+
+	// Fused continuations run on the executor the promise is completed on, set_inline runs them on the calling thread
+	void test_continuation_thread()
+	{
+		const auto caller = std::this_thread::get_id();
+		int on_caller = 0;
+		for (int i = 0; i < 100; ++i)
+		{
+			corsl::promise<int> promise;
+			auto result = promise.get_future().then([](int v) { return std::pair{ v, std::this_thread::get_id() }; });
+			promise.set(i);
+			const auto [value, thread] = result.get();
+			check(value == i, L"then receives the value");
+			on_caller += thread == caller;
+
+			corsl::promise<int> inline_promise;
+			auto inline_result = inline_promise.get_future().then([](int) { return std::this_thread::get_id(); });
+			inline_promise.set_inline(i);
+			check(inline_result.get() == caller, L"set_inline runs the continuation on the calling thread");
+		}
+		check(!on_caller, L"set does not run the continuation on the calling thread");
+	}
+
+	// Executor that cannot accept any work
+	struct failing_executor
+	{
+		static void schedule(std::coroutine_handle<>)
+		{
+			throw std::bad_alloc{};
+		}
+	};
+
+	// A promise completed on a failing executor resumes the awaiting coroutine on the calling thread
+	void test_executor_failure()
+	{
+		corsl::promise<int> promise;
+		std::thread::id resumed_on;
+		auto awaiting = [](corsl::future<int> future, std::thread::id &resumed_on) -> corsl::future<int>
+		{
+			const auto value = co_await future;
+			resumed_on = std::this_thread::get_id();
+			co_return value;
+		}(promise.get_future(), resumed_on);
+
+		promise.set_on(failing_executor{}, 42);
+		check(awaiting.get() == 42 && resumed_on == std::this_thread::get_id(), L"set_on resumes inline if the executor fails");
+	}
+
+	// Timed waits with extreme timeouts
+	void test_timed_wait()
+	{
+		corsl::promise<int> promise;
+		auto future = promise.get_future();
+		check(!future.wait_for(std::chrono::milliseconds::min()) && !future.wait_for(0ms), L"wait_for with a non-positive timeout does not wait");
+
+		std::thread setter{ [&]
+		{
+			std::this_thread::sleep_for(10ms);
+			promise.set(42);
+		} };
+		check(future.wait_for(std::chrono::milliseconds::max()) && future.get() == 42, L"wait_for with the maximum timeout waits for the value");
+		setter.join();
+	}
+
+	// Tests for shared_future.h and async_cache.h
+
+	// Waiters subscribe to a shared_future while it is completed from another thread
+	void test_shared_future_race()
+	{
+		constexpr int rounds = 2000;
+		constexpr int waiters = 8;
+
+		for (int round = 0; round < rounds; ++round)
+		{
+			corsl::promise<int> promise;
+			corsl::shared_future<int> shared{ promise.get_future() };
+
+			std::vector<corsl::future<int>> tasks;
+			tasks.reserve(waiters);
+			for (int i = 0; i < waiters; ++i)
+				tasks.push_back([](corsl::shared_future<int> shared) -> corsl::future<int>
+				{
+					co_await corsl::resume_background();
+					co_return co_await shared;
+				}(shared));
+
+			std::thread setter{ [&] { promise.set(round); } };
+			const auto results = corsl::block_get(corsl::when_all_range(std::move(tasks)));
+			setter.join();
+
+			if (std::accumulate(results.begin(), results.end(), 0LL) != static_cast<long long>(round) * waiters)
+			{
+				check(false, L"every shared_future waiter receives the value");
+				break;
+			}
+		}
+
+		// Thousands of waiters are resumed in one bulk operation
+		constexpr int many_waiters = 5000;
+		corsl::promise<int> promise;
+		corsl::shared_future<int> shared{ promise.get_future() };
+		std::vector<corsl::future<int>> tasks;
+		tasks.reserve(many_waiters);
+		for (int i = 0; i < many_waiters; ++i)
+			tasks.push_back([](corsl::shared_future<int> shared) -> corsl::future<int>
+			{
+				co_return co_await shared;
+			}(shared));
+
+		std::thread{ [&] { promise.set(1); } }.join();
+		const auto results = corsl::block_get(corsl::when_all_range(std::move(tasks)));
+		check(std::accumulate(results.begin(), results.end(), 0) == many_waiters, L"every one of many shared_future waiters receives the value");
+	}
+
+	// Concurrent lookups of the same keys share one load
+	void test_async_cache()
+	{
+		std::atomic<int> loads{ 0 };
+		corsl::async_cache<int, std::string> cache{ { .capacity = 64, .shards = 4 } };
+		auto loader = [&](int key) -> corsl::future<std::string>
+		{
+			++loads;
+			co_await corsl::resume_background();
+			std::this_thread::sleep_for(1ms);
+			co_return std::to_string(key);
+		};
+
+		std::vector<std::thread> threads;
+		std::atomic<int> matches{ 0 };
+		for (int t = 0; t < 8; ++t)
+			threads.emplace_back([&]
+			{
+				for (int key = 0; key < 32; ++key)
+					if (corsl::block_get(cache.get(key, loader)) == std::to_string(key))
+						++matches;
+			});
+		for (auto &thread : threads)
+			thread.join();
+		check(matches == 8 * 32 && loads == 32, L"async_cache loads each key once");
+	}
+
+	// Tests for when_all.h, when_any.h, when_n.h, when_all_bounded.h, as_completed.h and hedge.h
+
+	// Combinators resume the awaiting coroutine on the executor of the child that completes them
+	void test_combinator_thread()
+	{
+		const auto caller = std::this_thread::get_id();
+		auto resumed_on = [](auto awaitable) -> corsl::future<std::thread::id>
+		{
+			co_await std::move(awaitable);
+			co_return std::this_thread::get_id();
+		};
+
+		int on_caller = 0;
+		for (int i = 0; i < 100; ++i)
+		{
+			std::vector<corsl::promise<int>> promises(6);
+			const auto future = [&](size_t index) { return promises[index].get_future(); };
+
+			std::vector<corsl::future<std::thread::id>> awaiting;
+			awaiting.push_back(resumed_on(corsl::when_all(future(0), future(1))));
+			awaiting.push_back(resumed_on(corsl::when_any(future(2), future(3))));
+			std::vector<corsl::future<int>> range;
+			range.push_back(future(4));
+			range.push_back(future(5));
+			awaiting.push_back(resumed_on(corsl::when_n_range(2, std::move(range))));
+
+			for (auto &promise : promises)
+				promise.set(i);
+			for (auto &result : awaiting)
+				on_caller += result.get() == caller;
+		}
+		check(!on_caller, L"combinators do not resume the awaiting coroutine inside set");
+	}
+
+	// Losing tasks are cancelled when when_any, when_n or hedge completes
+	void test_loser_cancellation()
+	{
+		constexpr int rounds = 100;
+
+		std::atomic<int> cancelled{ 0 };
+		for (int round = 0; round < rounds; ++round)
+		{
+			corsl::cancellation_source source;
+			auto [index, value] = corsl::block_get(corsl::when_any(source, loser(cancelled), background_value(round), token_loser(source, cancelled)));
+			check(index == 1 && value == round, L"when_any returns the winner");
+		}
+		check(wait_until([&] { return cancelled == rounds * 2; }), L"when_any cancels the losers");
+
+		cancelled = 0;
+		{
+			corsl::cancellation_source source;
+			std::vector<corsl::future<int>> tasks;
+			for (int i = 0; i < 10; ++i)
+				tasks.push_back(i % 2 ? background_value(i) : loser(cancelled));
+			const auto results = corsl::block_get(corsl::when_n_range(source, 5, std::move(tasks)));
+			check(results.size() == 5 && source.is_cancelled(), L"when_n_range returns the first results");
+			for (auto &[index, value] : results)
+				check(index % 2 && static_cast<int>(index) == value, L"when_n_range returns the results with their indices");
+		}
+		check(wait_until([&] { return cancelled == 5; }), L"when_n_range cancels the losers");
+
+		int attempts = 0;
+		const auto hedged = corsl::block_get(corsl::hedge([&]
+		{
+			return ++attempts == 1 ? loser(cancelled) : background_value(42);
+		}, 5ms));
+		check(hedged == 42 && attempts == 2, L"hedge returns the backup attempt");
+		check(wait_until([&] { return cancelled == 6; }), L"hedge cancels the slower attempt");
+	}
+
+	// Combinators that start or collect many tasks concurrently
+	void test_combinators()
+	{
+		{
+			std::vector<corsl::task<int>> tasks;
+			for (int i = 0; i < 1000; ++i)
+				tasks.push_back(lazy_value(i));
+			const auto results = corsl::block_get(corsl::when_all_bounded(std::move(tasks), 8));
+			check(results.size() == 1000 && results[999] == 999, L"when_all_bounded keeps the results in order");
+		}
+
+		{
+			std::vector<corsl::future<int>> tasks;
+			for (int i = 0; i < 5000; ++i)
+				tasks.push_back(background_value(i));
+			const auto results = corsl::block_get(corsl::when_all_range(std::move(tasks), corsl::parallel_launch<>{ 256 }));
+			check(std::accumulate(results.begin(), results.end(), 0LL) == 5000LL * 4999 / 2, L"parallel_launch collects every result");
+		}
+
+		{
+			std::vector<corsl::future<int>> tasks;
+			for (int i = 0; i < 100; ++i)
+				tasks.push_back(background_value(i));
+			auto consume = [](corsl::async_generator<std::pair<size_t, int>> completed) -> corsl::future<int>
+			{
+				int count = 0;
+				for (auto it = co_await completed.begin(); it != completed.end(); it = co_await ++it)
+				{
+					auto [index, value] = *it;
+					check(static_cast<int>(index) == value, L"as_completed returns the results with their indices");
+					++count;
+				}
+				co_return count;
+			};
+			check(corsl::block_get(consume(corsl::as_completed(std::move(tasks)))) == 100, L"as_completed returns every result");
+		}
+
+		{
+			std::pmr::synchronized_pool_resource arena;
+			std::vector<corsl::future<int>> tasks;
+			for (int i = 0; i < 1000; ++i)
+				tasks.push_back(arena_value(std::allocator_arg, &arena, i));
+			const auto results = corsl::block_get(corsl::when_all_fail_fast_range(std::move(tasks)));
+			check(results.size() == 1000 && results[999] == 999, L"coroutines allocated from a memory resource");
+		}
+	}
+
+	// Tests for async_mpsc_queue.h and bounded_async_queue.h
+
+	// Producer threads push while the single consumer keeps parking on an empty queue
+	template<class Queue>
+	void mpsc_round(Queue &queue)
+	{
+		constexpr int producers = 8;
+		constexpr int values = 20000;
+
+		auto consumer = [](Queue &queue) -> corsl::future<bool>
+		{
+			std::vector<int> last(producers, -1);
+			for (int i = 0; i < producers * values; ++i)
+			{
+				auto [producer, value] = co_await queue.next();
+				if (value != last[producer] + 1)
+					co_return false;
+				last[producer] = value;
+			}
+			co_return true;
+		}(queue);
+
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+			threads.emplace_back([&, p]
+			{
+				for (int i = 0; i < values; ++i)
+				{
+					queue.push(std::pair{ p, i });
+					if (i % 1000 == 0)
+						std::this_thread::sleep_for(100us);
+				}
+			});
+		for (auto &thread : threads)
+			thread.join();
+
+		check(consumer.get(), L"values from each producer arrive in order");
+		check(queue.empty(), L"the queue is empty");
+	}
+
+	// Counts the consumers that are resumed while their queue is empty
+	struct empty_resume_counter
+	{
+		std::atomic<int> resumed_empty{ 0 };
+		std::function<bool()> queue_empty;
+	};
+
+	struct empty_resume_executor
+	{
+		empty_resume_counter *counter{};
+
+		void schedule(std::coroutine_handle<> handle) const
+		{
+			// the consumer is suspended, so its end of the queue does not change until it is resumed
+			if (counter->queue_empty())
+				++counter->resumed_empty;
+			corsl::resume_on_background(handle);
+		}
+	};
+
+	void test_mpsc_park_wake()
+	{
+		for (int round = 0; round < 5; ++round)
+		{
+			corsl::async_mpsc_queue<std::pair<int, int>> queue;
+			mpsc_round(queue);
+		}
+
+		corsl::work_stealing_pool pool;
+		corsl::async_mpsc_queue<std::pair<int, int>, corsl::work_stealing_executor> queue{ pool.get_executor() };
+		mpsc_round(queue);
+
+		// A producer only resumes the consumer it has published a value for
+		empty_resume_counter counter;
+		for (int round = 0; round < 5; ++round)
+		{
+			corsl::async_mpsc_queue<std::pair<int, int>, empty_resume_executor> checked{ { &counter } };
+			counter.queue_empty = [&] { return checked.empty(); };
+			mpsc_round(checked);
+		}
+		check(!counter.resumed_empty, L"the consumer is never resumed on an empty queue");
+	}
+
+	// cancel wakes a consumer that is parked on an empty queue or is taking values while producers push
+	void test_mpsc_cancel()
+	{
+		for (int round = 0; round < 200; ++round)
+		{
+			auto queue = std::make_unique<corsl::async_mpsc_queue<int>>();
+			std::atomic<int> received{ 0 };
+			auto consumer = [](corsl::async_mpsc_queue<int> &queue, std::atomic<int> &received) -> corsl::future<bool>
+			{
+				try
+				{
+					for (;;)
+					{
+						co_await queue.next();
+						++received;
+					}
+				}
+				catch (const corsl::operation_cancelled &)
+				{
+				}
+				co_return true;
+			}(*queue, received);
+
+			// odd rounds cancel while producers are still pushing
+			std::vector<std::thread> threads;
+			if (round % 2)
+				for (int p = 0; p < 4; ++p)
+					threads.emplace_back([&]
+					{
+						for (int i = 0; i < 1000; ++i)
+							queue->push(i);
+					});
+			wait_until([&] { return !(round % 2) || received >= 100; });
+			queue->cancel();
+			for (auto &thread : threads)
+				thread.join();
+
+			if (!consumer.wait_for(5s))
+			{
+				check(false, L"cancel wakes the consumer");
+				// the consumer still refers to the queue
+				(void)queue.release();
+				return;
+			}
+			check(consumer.get(), L"the consumer receives operation_cancelled");
+		}
+	}
+
+	// Producers park on a full bounded queue
+	void test_bounded_queue()
+	{
+		constexpr int producers = 8;
+		constexpr int values = 5000;
+		corsl::bounded_async_queue<int> bounded{ 16 };
+		std::vector<corsl::future<void>> tasks;
+		for (int p = 0; p < producers; ++p)
+			tasks.push_back([](corsl::bounded_async_queue<int> &bounded) -> corsl::future<void>
+			{
+				co_await corsl::resume_background();
+				for (int i = 0; i < values; ++i)
+					co_await bounded.push(i);
+			}(bounded));
+
+		auto consumer = [](corsl::bounded_async_queue<int> &bounded) -> corsl::future<long long>
+		{
+			long long sum = 0;
+			for (int i = 0; i < producers * values; ++i)
+				sum += co_await bounded.next();
+			co_return sum;
+		}(bounded);
+
+		corsl::block_wait(corsl::when_all_range(std::move(tasks)));
+		check(consumer.get() == static_cast<long long>(producers) * values * (values - 1) / 2, L"bounded_async_queue delivers every value");
+		check(bounded.empty(), L"bounded_async_queue is empty");
+	}
+
+	// Tests for async_queue.h and async_multi_queue.h
+
+	// Batch consumers race with producer threads pushing ranges
+	template<class Queue>
+	corsl::future<long long> batch_consumer(Queue &queue, std::atomic<int> &received, size_t max)
+	{
+		long long sum = 0;
+		std::vector<int> batch;
+		try
+		{
+			for (;;)
+			{
+				batch.clear();
+				const auto count = co_await queue.next_batch(max, batch);
+				check(count == batch.size() && count >= 1 && count <= max, L"next_batch returns between 1 and max values");
+				sum = std::accumulate(batch.begin(), batch.end(), sum);
+				received += static_cast<int>(count);
+			}
+		}
+		catch (const corsl::operation_cancelled &)
+		{
+		}
+		co_return sum;
+	}
+
+	template<class Queue>
+	void batch_round(Queue &queue, std::initializer_list<size_t> batch_sizes)
+	{
+		constexpr int producers = 4;
+		constexpr int values = 20000;
+
+		std::atomic<int> received{ 0 };
+		std::vector<corsl::future<long long>> consumers;
+		for (auto max : batch_sizes)
+			consumers.push_back(batch_consumer(queue, received, max));
+
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+			threads.emplace_back([&]
+			{
+				std::vector<int> chunk;
+				for (int i = 0; i < values; ++i)
+				{
+					chunk.push_back(i);
+					if (chunk.size() == 7)
+					{
+						queue.push_range(chunk);
+						chunk.clear();
+					}
+				}
+				queue.push_range(chunk);
+			});
+		for (auto &thread : threads)
+			thread.join();
+
+		check(wait_until([&] { return received == producers * values; }), L"batch consumers receive every value");
+		queue.cancel();
+
+		long long sum = 0;
+		for (auto &consumer : consumers)
+			sum += consumer.get();
+		check(sum == static_cast<long long>(producers) * values * (values - 1) / 2, L"batches add up to the pushed values");
+	}
+
+	void test_batches()
+	{
+		for (int round = 0; round < 5; ++round)
+		{
+			corsl::async_queue<int> queue;
+			batch_round(queue, { 64 });
+
+			// Several consumers with different batch sizes share the multi queue
+			corsl::async_multi_consumer_queue<int> multi_queue;
+			batch_round(multi_queue, { 1, 16, 64 });
+		}
+	}
+}
+
+void run_stress_tests()
+{
+	std::wcout << L"Running stress tests...\n";
+
+	const auto run = [](const wchar_t *name, void (*test)())
+	{
+		std::wcout << L"Stress test " << name << L" ...\n";
+		test();
+	};
+
+	run(L"bulk resumption", test_bulk_resume);
+	run(L"frame recycling", test_frame_recycling);
+	run(L"future detach vs publish", test_future_detach);
+	run(L"continuation thread", test_continuation_thread);
+	run(L"executor failure", test_executor_failure);
+	run(L"timed wait", test_timed_wait);
+	run(L"shared_future waiters vs completion", test_shared_future_race);
+	run(L"async_cache single flight", test_async_cache);
+	run(L"combinator thread", test_combinator_thread);
+	run(L"loser cancellation", test_loser_cancellation);
+	run(L"combinators", test_combinators);
+	run(L"MPSC park and wake", test_mpsc_park_wake);
+	run(L"MPSC cancel", test_mpsc_cancel);
+	run(L"bounded queue backpressure", test_bounded_queue);
+	run(L"next_batch vs push_range", test_batches);
+
+	if (failures)
+		std::wcout << failures << L" stress checks FAILED\n";
+	else
+		std::wcout << L"All stress tests passed\n";
+}